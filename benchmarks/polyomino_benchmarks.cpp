@@ -0,0 +1,235 @@
+#include "core_reference_model.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+//benchmarks of the hot paths on the reference model, with every genotype and draw fixed by BENCHMARK_SEED so runs are comparable
+//usage: polyomino_benchmarks [name filter] [--repeats N] [--csv]
+//each benchmark is timed over several repeats after a warm up, reporting the median and fastest time per operation
+
+using WideModel = HammingAssembly<uint64_t>;
+using NarrowModel = HammingAssembly<uint16_t>;
+
+constexpr uint64_t BENCHMARK_SEED=0x706f6c796f6d696e;
+
+struct BenchmarkOptions {
+  std::string filter;
+  size_t repeats=7;
+  bool csv=false;
+};
+
+//time body(), which performs ops operations, resetting the default generator before each call so every repeat draws the same values
+template<typename Body>
+void RunBenchmark(const BenchmarkOptions& options,const std::string& name,size_t ops,Body&& body) {
+  if(!options.filter.empty() && name.find(options.filter)==std::string::npos)
+    return;
+  RNG_Engine.seed(BENCHMARK_SEED);
+  body();
+
+  std::vector<double> op_times;
+  for(size_t repeat=0;repeat<options.repeats;++repeat) {
+    RNG_Engine.seed(BENCHMARK_SEED);
+    const auto start=std::chrono::steady_clock::now();
+    body();
+    const auto stop=std::chrono::steady_clock::now();
+    op_times.emplace_back(std::chrono::duration<double,std::nano>(stop-start).count()/ops);
+  }
+  std::sort(op_times.begin(),op_times.end());
+  const double median=op_times[op_times.size()/2], fastest=op_times.front();
+
+  if(options.csv)
+    std::cout<<name<<","<<median<<","<<fastest<<","<<ops<<"\n";
+  else
+    std::cout<<std::left<<std::setw(40)<<name<<std::right<<std::fixed<<std::setprecision(1)<<std::setw(14)<<median<<std::setw(14)<<fastest<<std::setw(10)<<ops<<"\n";
+}
+
+//keep a result alive so the optimiser cannot drop the work producing it
+template<typename T>
+inline void KeepResult(const T& value) {
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+//side x side square, where each subunit binds its right and upper neighbours through unique interface pairs
+//other faces are random, redrawn until nothing else binds, while periodic squares also bind across opposite edges and grow without bound
+template<typename Model>
+typename Model::Genotype SquareGenotype(size_t side,bool periodic,std::mt19937_64& rng) {
+  typename Model::Genotype genotype(4*side*side);
+  const size_t designed_edges=periodic ? 2*side*side : 2*side*(side-1);
+  do {
+    std::generate(genotype.begin(),genotype.end(),[&rng](){return static_cast<typename Model::interface_type>(rng());});
+    for(size_t row=0;row<side;++row)
+      for(size_t column=0;column<side;++column) {
+        const size_t subunit=row*side+column;
+        if(column+1<side || periodic)
+          genotype[4*(row*side+(column+1)%side)+3]=Model::PerfectPartner(genotype[4*subunit+1]);
+        if(row+1<side || periodic)
+          genotype[4*(((row+1)%side)*side+column)+2]=Model::PerfectPartner(genotype[4*subunit]);
+      }
+  }while(Model::GetActiveInterfaces(genotype).size()!=designed_edges);
+  return genotype;
+}
+
+//random phenotypes of a fixed size, used to fill tables
+std::vector<Phenotype> RandomPhenotypes(size_t count,uint8_t side,size_t tiles,std::mt19937_64& rng) {
+  std::vector<Phenotype> phenotypes;
+  std::vector<uint8_t> tiling(side*side);
+  while(phenotypes.size()<count) {
+    std::fill(tiling.begin(),tiling.end(),0);
+    std::fill(tiling.begin(),tiling.begin()+tiles,1);
+    std::shuffle(tiling.begin(),tiling.end(),rng);
+    for(uint8_t& tile : tiling)
+      if(tile)
+        tile=static_cast<uint8_t>(1+rng()%16);
+    phenotypes.emplace_back(side,side,tiling);
+  }
+  return phenotypes;
+}
+
+void InterfaceBenchmarks(const BenchmarkOptions& options) {
+  std::mt19937_64 rng(BENCHMARK_SEED);
+  for(size_t subunits : {4,16,64}) {
+    std::vector<WideModel::Genotype> genotypes(64,WideModel::Genotype(4*subunits));
+    for(auto& genotype : genotypes)
+      std::generate(genotype.begin(),genotype.end(),[&rng](){return rng();});
+    RunBenchmark(options,"GetActiveInterfaces/"+std::to_string(subunits)+"_subunits",genotypes.size(),[&]() {
+        for(const auto& genotype : genotypes)
+          KeepResult(WideModel::GetActiveInterfaces(genotype));});
+  }
+}
+
+//placed tiles hold tile details in an int8_t, so assembled genotypes are limited to 31 subunits
+void AssemblyBenchmarks(const BenchmarkOptions& options) {
+  std::mt19937_64 rng(BENCHMARK_SEED);
+  const std::vector<std::pair<std::string,WideModel::Genotype>> cases{
+    {"small",SquareGenotype<WideModel>(2,false,rng)},
+    {"large",SquareGenotype<WideModel>(5,false,rng)},
+    {"unbound",SquareGenotype<WideModel>(4,true,rng)}};
+
+  AssemblyContext context;
+  for(const auto& [label,genotype] : cases) {
+    const InterfaceAdjacency adjacency(WideModel::GetActiveInterfaces(genotype));
+    constexpr size_t ASSEMBLIES=200;
+    RunBenchmark(options,"AssemblePolyomino/"+label,ASSEMBLIES,[&]() {
+        for(size_t assembly=0;assembly<ASSEMBLIES;++assembly)
+          KeepResult(WideModel::AssemblePolyomino(adjacency,context));});
+
+    if(label=="unbound")
+      continue;
+    WideModel::AssemblePolyomino(adjacency,context);
+    const std::vector<int8_t> placed_tiles=context.placed_tiles;
+    Phenotype phen;
+    RunBenchmark(options,"GetPhenotypeFromGrid/"+label,ASSEMBLIES,[&]() {
+        for(size_t assembly=0;assembly<ASSEMBLIES;++assembly) {
+          GetPhenotypeFromGrid(placed_tiles,phen);
+          KeepResult(phen);
+        }});
+
+    //uncanonicalised copy of the phenotype, so the minimisation has work to do
+    GetPhenotypeFromGrid(placed_tiles,phen);
+    ClockwiseRotation(phen);
+    Phenotype minimised;
+    RunBenchmark(options,"GetMinPhenRepresentation/"+label,ASSEMBLIES,[&]() {
+        for(size_t assembly=0;assembly<ASSEMBLIES;++assembly) {
+          minimised=phen;
+          GetMinPhenRepresentation(minimised);
+          KeepResult(minimised);
+        }});
+  }
+}
+
+template<typename Table>
+void TableLookups(const BenchmarkOptions& options,const std::string& table_name,size_t table_size,std::mt19937_64& rng) {
+  std::vector<Phenotype> phenotypes=RandomPhenotypes(2*table_size,6,16,rng);
+  Table table;
+  table.known_phenotypes[16].assign(phenotypes.begin(),phenotypes.begin()+table_size);
+  table.FIXED_TABLE=true;
+
+  //hits are found in the table, misses fall through (the fixed table leaves it unchanged)
+  for(const bool hit : {true,false}) {
+    const auto first=phenotypes.begin()+(hit ? 0 : table_size);
+    std::vector<Phenotype> queries;
+    for(size_t query=0;query<1000;++query)
+      queries.emplace_back(first[rng()%table_size]);
+    RunBenchmark(options,"GetPhenotypeID/"+table_name+"_"+std::to_string(table_size)+(hit ? "_hit" : "_miss"),queries.size(),[&]() {
+        for(Phenotype& query : queries)
+          KeepResult(table.GetPhenotypeID(query));});
+  }
+}
+
+void TableBenchmarks(const BenchmarkOptions& options) {
+  std::mt19937_64 rng(BENCHMARK_SEED);
+  for(size_t table_size : {10,1000,30000})
+    TableLookups<PhenotypeTable>(options,"table",table_size,rng);
+  TableLookups<ConcurrentPhenotypeTable>(options,"concurrent",30000,rng);
+}
+
+void SelectionBenchmarks(const BenchmarkOptions& options) {
+  std::mt19937_64 rng(BENCHMARK_SEED);
+  for(size_t population_size : {1000,100000}) {
+    std::vector<double> fitnesses(population_size);
+    std::generate(fitnesses.begin(),fitnesses.end(),[&rng](){return std::uniform_real_distribution<double>(0,1)(rng);});
+    const std::string size_label="/"+std::to_string(population_size);
+
+    //the roulette wheel sums the fitnesses in place, so each call works on a fresh copy
+    std::vector<double> weights;
+    RunBenchmark(options,"RouletteWheelSelection"+size_label,1,[&]() {
+        weights=fitnesses;
+        KeepResult(RouletteWheelSelection(weights));});
+    RunBenchmark(options,"StochasticUniversalSampling"+size_label,1,[&]() {
+        KeepResult(StochasticUniversalSampling(fitnesses));});
+    RunBenchmark(options,"AliasSelection"+size_label,1,[&]() {
+        KeepResult(AliasSelection(fitnesses));});
+  }
+}
+
+//seeded evolution of narrow interfaces, which interact often enough for most genotypes to assemble
+void GenerationBenchmarks(const BenchmarkOptions& options) {
+  constexpr size_t POPULATION_SIZE=1000, GENERATIONS=10;
+  std::mt19937_64 rng(BENCHMARK_SEED);
+  std::vector<NarrowModel::Genotype> initial_genotypes(POPULATION_SIZE,NarrowModel::Genotype(4*4));
+  for(auto& genotype : initial_genotypes)
+    std::generate(genotype.begin(),genotype.end(),[&rng](){return static_cast<uint16_t>(rng());});
+
+  std::vector<size_t> thread_counts{1};
+  if(std::thread::hardware_concurrency()>1)
+    thread_counts.emplace_back(std::thread::hardware_concurrency());
+  for(size_t threads : thread_counts) {
+    //the pool and worker buffers are built once, and each repeat restarts from the initial population on an empty table
+    ConcurrentFitnessPhenotypeTable table;
+    PopulationEvolution<NarrowModel,NarrowModel::Genotype> evolution(table,initial_genotypes,threads,BENCHMARK_SEED);
+    RunBenchmark(options,"Generation/"+std::to_string(POPULATION_SIZE)+"_genotypes_"+std::to_string(threads)+"_threads",GENERATIONS,[&]() {
+        table.ClearTable();
+        evolution.genotypes=initial_genotypes;
+        evolution.generation=0;
+        for(size_t generation=0;generation<GENERATIONS;++generation)
+          KeepResult(evolution.Generation([](NarrowModel::Genotype& genotype,auto& mutation_rng){NarrowModel::Mutation(genotype,mutation_rng);}));});
+  }
+}
+
+int main(int argc,char* argv[]) {
+  BenchmarkOptions options;
+  for(int arg=1;arg<argc;++arg) {
+    if(!std::strcmp(argv[arg],"--repeats") && arg+1<argc)
+      options.repeats=std::max(1,std::atoi(argv[++arg]));
+    else if(!std::strcmp(argv[arg],"--csv"))
+      options.csv=true;
+    else
+      options.filter=argv[arg];
+  }
+
+  if(options.csv)
+    std::cout<<"benchmark,median_ns_per_op,fastest_ns_per_op,ops\n";
+  else
+    std::cout<<std::left<<std::setw(40)<<"benchmark"<<std::right<<std::setw(14)<<"median ns/op"<<std::setw(14)<<"fastest ns/op"<<std::setw(10)<<"ops"<<"\n";
+
+  InterfaceBenchmarks(options);
+  AssemblyBenchmarks(options);
+  TableBenchmarks(options);
+  SelectionBenchmarks(options);
+  GenerationBenchmarks(options);
+  return 0;
+}
@@ -0,0 +1,438 @@
+#pragma once
+#include "core_phenotype.hpp"
+#include "core_genotype.hpp"
+#include "core_evolution.hpp"
+#include "core_table_io.hpp"
+#include <filesystem>
+#include <limits>
+#include <numeric>
+#include <type_traits>
+
+//detect models that can draw a random interface from a given generator, Q::GenRandomSite(rng), which sampled enumeration needs
+template<class Q, class=void>
+struct HasRandomSites : std::false_type {};
+template<class Q>
+struct HasRandomSites<Q,std::void_t<decltype(Q::GenRandomSite(std::declval<Philox4x32&>()))>> : std::true_type {};
+
+//product of two factors, saturating at the largest uint64_t
+inline uint64_t SaturatingMultiply(uint64_t left,uint64_t right) {
+  uint64_t product;
+  return __builtin_mul_overflow(left,right,&product) ? std::numeric_limits<uint64_t>::max() : product;
+}
+
+//binomial coefficient, saturating at the largest uint64_t
+//each step is the exact coefficient C(n-k+factor,factor), dividing out the common factor first so only a result that is too large overflows
+inline uint64_t SaturatingBinomial(uint64_t n,uint64_t k) {
+  if(k>n)
+    return 0;
+  k=std::min(k,n-k);
+  uint64_t coefficient=1;
+  for(uint64_t factor=1;factor<=k && coefficient!=std::numeric_limits<uint64_t>::max();++factor) {
+    const uint64_t common=std::gcd(coefficient,factor);
+    coefficient=SaturatingMultiply(coefficient/common,(n-k+factor)/(factor/common));
+  }
+  return coefficient;
+}
+
+//product of the numerators over the product of the denominators, for factors whose quotient is an integer, saturating at the largest uint64_t
+//every denominator is cancelled against the numerators before multiplying, so only a quotient that is too large overflows
+inline uint64_t SaturatingQuotient(std::vector<uint64_t>& numerators,const std::vector<uint64_t>& denominators) {
+  for(uint64_t denominator : denominators)
+    for(size_t index=0;index<numerators.size() && denominator>1;++index) {
+      const uint64_t common=std::gcd(numerators[index],denominator);
+      numerators[index]/=common;
+      denominator/=common;
+    }
+  uint64_t quotient=1;
+  for(uint64_t numerator : numerators)
+    quotient=SaturatingMultiply(quotient,numerator);
+  return quotient;
+}
+
+//parallel map from a genotype space of model Q to the pids of each genotype's builds, for surveying genotype-phenotype landscapes
+//exhaustive enumeration covers every genotype of a number of subunits with interfaces from an alphabet, keeping one representative for genotypes that
+//only differ by rotating subunits or (with free seeds) permuting them, along with the number of genotypes it stands for
+//a permutation that changes which subunit is the last one with an edge changes how assembly is seeded, so each such arrangement keeps its own record
+//sampled enumeration instead draws genotypes from Q::GenRandomSite(rng), every sample from its own stream so the samples do not depend on the thread count
+//
+//work is done in blocks over a work-stealing pool; after each block, pids are relabelled, records are appended to a text file, and a checkpoint is written,
+//so a later Run with the same files resumes after the last complete block, giving the same records as an uninterrupted run
+//each record is one line of "unit multiplicity sites... : size index count ...", with a (pid, count) triple per distinct pid among the builds,
+//where pids left undiscovered by the table are written as NULL_pid
+//an optional AssemblyCache skips assembly of genotypes whose interaction graph was seen before, such as those equal up to interface relabelling
+template<class Q, class Genotype, class Table=ConcurrentPhenotypeTable>
+class GenotypeEnumeration {
+  static_assert(std::is_base_of<ConcurrentPhenotypeTable,Table>::value,"parallel enumeration needs a table derived from ConcurrentPhenotypeTable");
+
+public:
+  using Site=typename Genotype::value_type;
+
+  //units per block, between which records and checkpoints are written; resuming needs the same block size
+  uint64_t block_size=1<<14;
+  AssemblyCache* assembly_cache=nullptr;
+
+  //exhaustive enumeration, where alphabets beyond 64 interfaces are refused (Size()==0)
+  GenotypeEnumeration(Table& shared_table,size_t subunit_count,std::vector<Site> interface_alphabet,uint64_t seed=0,size_t thread_count=std::thread::hardware_concurrency()) :
+    table(shared_table), pool(thread_count), contexts(pool.WorkerCount()), worker_codes(pool.WorkerCount()), subunits(subunit_count), alphabet(std::move(interface_alphabet)), rng_seed(seed) {
+    if(alphabet.size()<=64)
+      FindRotationMinimalSubunits();
+    for(BuildContext& context : contexts)
+      context.edge_usage_needed=false;
+  }
+
+  //sampled enumeration of a given number of genotypes
+  GenotypeEnumeration(Table& shared_table,size_t subunit_count,uint64_t sample_count,uint64_t seed,size_t thread_count=std::thread::hardware_concurrency()) :
+    table(shared_table), pool(thread_count), contexts(pool.WorkerCount()), worker_codes(pool.WorkerCount()), subunits(subunit_count), samples(sample_count), rng_seed(seed) {
+    static_assert(HasRandomSites<Q>::value,"sampled enumeration needs Q::GenRandomSite(rng)");
+    sampled=true;
+    for(BuildContext& context : contexts)
+      context.edge_usage_needed=false;
+  }
+
+  //units of work in the space, each a combination (or with fixed seeds, a sequence) of subunits, or a sample
+  //zero if the space cannot be enumerated, e.g. more than 2^64 units or 20 subunits
+  inline uint64_t Size() const {
+    if(sampled)
+      return samples;
+    if(!subunits || subunits>20 || subunit_codes.empty())
+      return 0;
+    const uint64_t code_count=subunit_codes.size();
+    uint64_t units=1;
+    if(Q::free_seed)
+      units=SaturatingBinomial(code_count+subunits-1,subunits);
+    else
+      for(size_t subunit=0;subunit<subunits && units!=std::numeric_limits<uint64_t>::max();++subunit)
+        units=units>std::numeric_limits<uint64_t>::max()/code_count ? std::numeric_limits<uint64_t>::max() : units*code_count;
+    return units==std::numeric_limits<uint64_t>::max() ? 0 : units;
+  }
+  inline uint64_t NextUnit() const {return next_unit;}
+
+  //evaluate at least max_units further units (in whole blocks), resuming from the checkpoint if there is one and starting the record file afresh otherwise
+  //undiscovered phenotypes are promoted per block, so blocks are never split and an interrupted run resumes to the same records
+  //returns false if the space cannot be enumerated, the checkpoint belongs to a different enumeration, or a file cannot be written
+  inline bool Run(const std::string& record_name,const std::string& checkpoint_name,uint64_t max_units=std::numeric_limits<uint64_t>::max()) {
+    const uint64_t total_units=Size();
+    if(!total_units || !block_size || !ResumeCheckpoint(record_name,checkpoint_name))
+      return false;
+    std::ofstream record_file(record_name,std::ios::app);
+    if(!record_file)
+      return false;
+
+    for(uint64_t units_run=0;next_unit<total_units && units_run<max_units;) {
+      const uint64_t block_units=std::min(block_size,total_units-next_unit);
+      block_records.resize(block_units);
+      pool.ParallelFor((block_units+CHUNK_UNITS-1)/CHUNK_UNITS,[this,block_units](size_t chunk,size_t worker) {
+        const uint64_t first_unit=chunk*CHUNK_UNITS, last_unit=std::min<uint64_t>(first_unit+CHUNK_UNITS,block_units);
+        EvaluateChunk(next_unit+first_unit,next_unit+last_unit,worker);
+      });
+
+      //barrier reached, so pids are relabelled and records written in unit order
+      for(std::vector<EnumerationRecord>& unit_records : block_records)
+        for(EnumerationRecord& record : unit_records)
+          table.RelabelPIDs(record.pids);
+      if(assembly_cache)
+        for(std::vector<EnumerationRecord>& unit_records : block_records)
+          for(EnumerationRecord& record : unit_records)
+            if(!record.cached)
+              assembly_cache->Insert(record.key,record.pids,table);
+      table.ClearIncomplete();
+
+      for(uint64_t unit_offset=0;unit_offset<block_units;++unit_offset)
+        for(EnumerationRecord& record : block_records[unit_offset])
+          WriteRecord(record_file,next_unit+unit_offset,record);
+      record_file.flush();
+      if(!record_file)
+        return false;
+
+      next_unit+=block_units;
+      units_run+=block_units;
+      if(!WriteCheckpoint(checkpoint_name,static_cast<uint64_t>(record_file.tellp())))
+        return false;
+    }
+    return true;
+  }
+
+private:
+  static constexpr uint64_t CHUNK_UNITS=64;
+  static constexpr uint32_t CHECKPOINT_VERSION=1;
+
+  struct EnumerationRecord {
+    Genotype genotype;
+    uint64_t multiplicity=1;
+    std::vector<Phenotype_ID> pids;
+    InteractionGraphKey key;
+    bool cached=false;
+  };
+
+  Table& table;
+  WorkStealingPool pool;
+  std::vector<BuildContext> contexts;
+  std::vector<std::vector<uint32_t> > worker_codes;
+  std::vector<std::vector<EnumerationRecord> > block_records;
+
+  size_t subunits;
+  std::vector<Site> alphabet;
+  uint64_t samples=0;
+  uint64_t rng_seed;
+  bool sampled=false;
+  uint64_t next_unit=0;
+
+  //subunits as alphabet indices, keeping only the smallest of their four rotations, and how many distinct rotations each has
+  std::vector<std::array<uint8_t,4> > subunit_codes;
+  std::vector<uint8_t> rotation_counts;
+
+  inline void FindRotationMinimalSubunits() {
+    const uint32_t letters=static_cast<uint32_t>(alphabet.size());
+    for(uint32_t packed=0;packed<letters*letters*letters*letters;++packed) {
+      const std::array<uint8_t,4> faces{static_cast<uint8_t>(packed/(letters*letters*letters)),static_cast<uint8_t>(packed/(letters*letters)%letters),
+                                        static_cast<uint8_t>(packed/letters%letters),static_cast<uint8_t>(packed%letters)};
+      bool minimal=true;
+      uint8_t rotations=4;
+      for(uint8_t rotation=1;rotation<4 && minimal;++rotation) {
+        const std::array<uint8_t,4> rotated{faces[rotation],faces[(rotation+1)%4],faces[(rotation+2)%4],faces[(rotation+3)%4]};
+        minimal=!(rotated<faces);
+        if(rotated==faces)
+          rotations=std::min(rotations,rotation);
+      }
+      if(minimal) {
+        subunit_codes.emplace_back(faces);
+        rotation_counts.emplace_back(rotations);
+      }
+    }
+  }
+
+  //combinations are non-decreasing code sequences in lexicographic order, found by stepping over the runs of sequences with each leading code
+  inline void UnrankCombination(uint64_t rank,std::vector<uint32_t>& codes) const {
+    const uint64_t code_count=subunit_codes.size();
+    codes.resize(subunits);
+    uint64_t code=0;
+    for(size_t position=0;position<subunits;++position) {
+      //sequences from here on with this position at least c number C(code_count-c+remaining,remaining+1), so search for the last code not passing the rank
+      const uint64_t remaining=subunits-position-1, from_code=SaturatingBinomial(code_count-code+remaining,remaining+1);
+      uint64_t low=code,high=code_count-1;
+      while(low<high) {
+        const uint64_t middle=(low+high+1)/2;
+        if(from_code-SaturatingBinomial(code_count-middle+remaining,remaining+1)<=rank)
+          low=middle;
+        else
+          high=middle-1;
+      }
+      rank-=from_code-SaturatingBinomial(code_count-low+remaining,remaining+1);
+      code=low;
+      codes[position]=static_cast<uint32_t>(code);
+    }
+  }
+  inline void UnrankSequence(uint64_t rank,std::vector<uint32_t>& codes) const {
+    codes.resize(subunits);
+    for(size_t position=subunits;position!=0;--position) {
+      codes[position-1]=static_cast<uint32_t>(rank%subunit_codes.size());
+      rank/=subunit_codes.size();
+    }
+  }
+
+  //step to the next combination or sequence, as an odometer where combinations reset to the advanced code rather than zero
+  inline void NextCodes(std::vector<uint32_t>& codes) const {
+    const uint32_t last_code=static_cast<uint32_t>(subunit_codes.size()-1);
+    size_t position=subunits;
+    while(position && codes[position-1]==last_code)
+      --position;
+    if(!position)
+      return;
+    ++codes[position-1];
+    std::fill(codes.begin()+position,codes.end(),Q::free_seed ? codes[position-1] : 0);
+  }
+
+  inline void ArrangeGenotype(const std::vector<uint32_t>& codes,Genotype& genotype) const {
+    genotype.resize(4*codes.size());
+    for(size_t subunit=0;subunit<codes.size();++subunit)
+      for(uint8_t face=0;face<4;++face)
+        genotype[4*subunit+face]=alphabet[subunit_codes[codes[subunit]][face]];
+  }
+
+  inline void EvaluateChunk(uint64_t first_unit,uint64_t last_unit,size_t worker) {
+    std::vector<uint32_t>& codes=worker_codes[worker];
+    if constexpr(HasRandomSites<Q>::value)
+      if(sampled) {
+        for(uint64_t unit=first_unit;unit<last_unit;++unit) {
+          std::vector<EnumerationRecord>& unit_records=block_records[unit-next_unit];
+          unit_records.resize(1);
+          Philox4x32 sample_stream(rng_seed,static_cast<uint32_t>(unit>>32),static_cast<uint32_t>(unit),Philox4x32::MUTATION_STREAM);
+          unit_records[0].genotype.resize(4*subunits);
+          std::generate(unit_records[0].genotype.begin(),unit_records[0].genotype.end(),[&sample_stream](){return Q::GenRandomSite(sample_stream);});
+          unit_records[0].multiplicity=1;
+          EvaluateGenotype(unit_records[0],unit,0,contexts[worker]);
+        }
+        return;
+      }
+
+    if(Q::free_seed)
+      UnrankCombination(first_unit,codes);
+    else
+      UnrankSequence(first_unit,codes);
+    for(uint64_t unit=first_unit;unit<last_unit;++unit,NextCodes(codes))
+      EvaluateCodes(codes,unit,contexts[worker],block_records[unit-next_unit]);
+  }
+
+  //a combination stands for every arrangement of its subunits, split by how many subunits without edges trail the last one with an edge
+  //with t of the e subunits without edges trailing, and k with edges, there are e!/(e-t)! * k * (n-t-1)! labelled arrangements, divided by the repeats of each code
+  inline void EvaluateCodes(const std::vector<uint32_t>& codes,uint64_t unit,BuildContext& context,std::vector<EnumerationRecord>& unit_records) {
+    uint64_t rotations=1;
+    for(uint32_t code : codes)
+      rotations*=rotation_counts[code];
+
+    unit_records.resize(1);
+    ArrangeGenotype(codes,unit_records[0].genotype);
+    unit_records[0].multiplicity=rotations;
+    if(!Q::free_seed) {
+      EvaluateGenotype(unit_records[0],unit,0,context);
+      return;
+    }
+
+    thread_local std::vector<uint32_t> edged_codes,edgeless_codes,arranged_codes;
+    thread_local std::vector<uint8_t> has_edge;
+    has_edge.assign(subunits,false);
+    for(const auto& edge : Q::GetActiveInterfaces(unit_records[0].genotype)) {
+      has_edge[edge.first.first/4]=true;
+      has_edge[edge.first.second/4]=true;
+    }
+    edged_codes.clear();
+    edgeless_codes.clear();
+    for(size_t subunit=0;subunit<subunits;++subunit)
+      (has_edge[subunit] ? edged_codes : edgeless_codes).emplace_back(codes[subunit]);
+
+    //multiplicities are kept as factors, so the division by repeats is exact before anything can saturate
+    thread_local std::vector<uint64_t> repeat_factors,labelled_factors;
+    repeat_factors.clear();
+    for(size_t run_start=0,run_end=0;run_start<subunits;run_start=run_end) {
+      while(run_end<subunits && codes[run_end]==codes[run_start])
+        ++run_end;
+      for(size_t factor=2;factor<=run_end-run_start;++factor)
+        repeat_factors.emplace_back(factor);
+    }
+    const auto add_factorial=[](size_t value) {
+      for(size_t factor=2;factor<=value;++factor)
+        labelled_factors.emplace_back(factor);
+    };
+
+    //no edges at all always assembles a monomer, so every arrangement is the same
+    if(edged_codes.empty()) {
+      labelled_factors.assign(1,rotations);
+      add_factorial(subunits);
+      unit_records[0].multiplicity=SaturatingQuotient(labelled_factors,repeat_factors);
+      EvaluateGenotype(unit_records[0],unit,0,context);
+      return;
+    }
+
+    const size_t edgeless=edgeless_codes.size();
+    unit_records.resize(edgeless+1);
+    for(size_t trailing=0;trailing<=edgeless;++trailing) {
+      EnumerationRecord& record=unit_records[trailing];
+      arranged_codes.assign(edgeless_codes.begin(),edgeless_codes.end()-trailing);
+      arranged_codes.insert(arranged_codes.end(),edged_codes.begin(),edged_codes.end());
+      arranged_codes.insert(arranged_codes.end(),edgeless_codes.end()-trailing,edgeless_codes.end());
+      ArrangeGenotype(arranged_codes,record.genotype);
+      labelled_factors.assign({rotations,edged_codes.size()});
+      for(size_t factor=edgeless-trailing+1;factor<=edgeless;++factor)
+        labelled_factors.emplace_back(factor);
+      add_factorial(subunits-trailing-1);
+      record.multiplicity=SaturatingQuotient(labelled_factors,repeat_factors);
+      EvaluateGenotype(record,unit,static_cast<uint32_t>(trailing),context);
+    }
+  }
+
+  //builds draw from streams keyed by the unit and, for the arrangements of one unit, the variant
+  inline void EvaluateGenotype(EnumerationRecord& record,uint64_t unit,uint32_t variant,BuildContext& context) {
+    const std::vector<std::pair<InteractionPair,double> > edges=Q::GetActiveInterfaces(record.genotype);
+    record.cached=false;
+    if(assembly_cache) {
+      CanonicalInteractionGraph(edges,Q::free_seed,record.key);
+      if(assembly_cache->Find(record.key,record.pids)) {
+        record.cached=true;
+        return;
+      }
+    }
+    const InterfaceAdjacency adjacency(edges);
+    AssembleBuildsAnalysed<Q>(adjacency,table,context,[this,unit,variant](uint16_t build) {
+        return Philox4x32(rng_seed,static_cast<uint32_t>(unit>>32),static_cast<uint32_t>(unit),variant<<16 | build);});
+    record.pids.assign(context.pids.begin(),context.pids.end());
+  }
+
+  inline void WriteRecord(std::ofstream& record_file,uint64_t unit,EnumerationRecord& record) const {
+    record_file<<unit<<" "<<record.multiplicity;
+    for(const Site& site : record.genotype) {
+      if constexpr(std::is_integral<Site>::value)
+        record_file<<" "<<+site;
+      else
+        record_file<<" "<<site;
+    }
+    record_file<<" :";
+
+    for(Phenotype_ID& pid : record.pids)
+      if(pid!=UNBOUND_pid && !table.IsKnown(pid))
+        pid=NULL_pid;
+    std::sort(record.pids.begin(),record.pids.end());
+    for(auto run_start=record.pids.begin();run_start!=record.pids.end();) {
+      const auto run_end=std::find_if(run_start,record.pids.end(),[run_start](const Phenotype_ID& pid){return pid!=*run_start;});
+      record_file<<" "<<+run_start->first<<" "<<run_start->second<<" "<<(run_end-run_start);
+      run_start=run_end;
+    }
+    record_file<<"\n";
+  }
+
+  //everything that changes the records, so a checkpoint is only resumed by the same enumeration
+  inline std::string Parameters() const {
+    std::ostringstream parameters;
+    parameters<<(sampled ? "sampled " : "exhaustive ")<<subunits<<" "<<samples<<" "<<rng_seed<<" "<<block_size<<" "<<Table::phenotype_builds<<" "
+              <<Q::free_seed<<" "<<+Phenotype::DETERMINISM_LEVEL<<" "<<Phenotype::FREE_POLYOMINO;
+    for(const Site& site : alphabet) {
+      if constexpr(std::is_integral<Site>::value)
+        parameters<<" "<<+site;
+      else
+        parameters<<" "<<site;
+    }
+    return parameters.str();
+  }
+
+  //the table is written before the checkpoint, and each is moved into place once complete,
+  //so a checkpoint never refers to a table missing phenotypes its records use
+  inline bool WriteCheckpoint(const std::string& checkpoint_name,uint64_t record_bytes) const {
+    if(!WriteBinaryTable(table,checkpoint_name+".table.tmp"))
+      return false;
+    {
+      std::ofstream checkpoint_file(checkpoint_name+".tmp");
+      checkpoint_file<<"polyomino_enumeration "<<CHECKPOINT_VERSION<<"\n"<<Parameters()<<"\n"<<next_unit<<" "<<record_bytes<<"\n";
+      if(!checkpoint_file.flush())
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::rename(checkpoint_name+".table.tmp",checkpoint_name+".table",error);
+    if(!error)
+      std::filesystem::rename(checkpoint_name+".tmp",checkpoint_name,error);
+    return !error;
+  }
+
+  //restore the table and position from a checkpoint, cutting the record file back to the last complete block
+  inline bool ResumeCheckpoint(const std::string& record_name,const std::string& checkpoint_name) {
+    std::ifstream checkpoint_file(checkpoint_name);
+    if(!checkpoint_file) {
+      next_unit=0;
+      return static_cast<bool>(std::ofstream(record_name,std::ios::trunc));
+    }
+
+    std::string format,parameters;
+    uint32_t version=0;
+    uint64_t record_bytes=0;
+    checkpoint_file>>format>>version;
+    checkpoint_file.ignore(std::numeric_limits<std::streamsize>::max(),'\n');
+    std::getline(checkpoint_file,parameters);
+    checkpoint_file>>next_unit>>record_bytes;
+    if(!checkpoint_file || format!="polyomino_enumeration" || version!=CHECKPOINT_VERSION || parameters!=Parameters())
+      return false;
+
+    if(!LoadBinaryTable(table,checkpoint_name+".table"))
+      return false;
+    std::error_code error;
+    std::filesystem::resize_file(record_name,record_bytes,error);
+    return !error;
+  }
+};
@@ -1,11 +1,228 @@
 #pragma once
 #include <functional>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
 
-using PopulationSize = uint16_t;
+//index type for genotypes within a population, wide enough for populations beyond 65,535 unless overridden at compile time
+#ifndef POLYOMINO_POPULATION_SIZE
+#define POLYOMINO_POPULATION_SIZE uint32_t
+#endif
+using PopulationSize = POLYOMINO_POPULATION_SIZE;
 
-//simple extension of PhenotypeTable to include fitnesses accessed via pid
-struct FitnessPhenotypeTable : PhenotypeTable {
+//reusable state for assembling and classifying all the builds of a genotype, one per thread
+//after AssembleBuilds, pids holds one pid per build and edge_usage counts the builds that used each edge
+struct BuildContext {
+  AssemblyContext assembly;
+  Phenotype phenotype;
+  std::vector<Phenotype_ID> pids;
+  std::vector<uint16_t> edge_usage;
+
+  //static analysis state, where closure_edges are the edges every build uses if fixed_edge_usage is set
+  ClosureContext closure;
+  Phenotype seed_phenotype;
+  std::vector<uint64_t> closure_edges;
+  bool fixed_edge_usage=false;
+
+  //deterministic genotypes whose builds can use different edges are still built for their edge usage, unless it is not needed
+  bool edge_usage_needed=true;
+
+  //the genotype's interaction graph, for callers that rebuild it per genotype rather than holding their own
+  std::vector<std::pair<InteractionPair,double> > edges;
+  InterfaceAdjacency adjacency;
+};
+
+//assemble a genotype phenotype_builds times against the context buffers, classifying each build with the table
+//unbound builds are recorded as UNBOUND_pid
+template<class Q, class Table>
+inline void AssembleBuilds(const InterfaceAdjacency& adjacency, Table& table, BuildContext& context) {
+  AssembleBuilds<Q>(adjacency,table,context,[](uint16_t) -> std::mt19937& {return RNG_Engine;});
+}
+
+//assemble and classify one build into the context, adding its edge usage and pid
+template<class Q, class Table, class URBG>
+inline Phenotype_ID AssembleBuild(const InterfaceAdjacency& adjacency, Table& table, BuildContext& context, URBG& rng) {
+  if(!Q::AssemblePolyomino(adjacency,context.assembly,rng))
+    return context.pids.emplace_back(UNBOUND_pid);
+  for(uint32_t edge_index=0;edge_index<context.edge_usage.size();++edge_index)
+    context.edge_usage[edge_index]+=context.assembly.EdgeUsed(edge_index);
+    
+  GetPhenotypeFromGrid(context.assembly.placed_tiles,context.phenotype);
+  return context.pids.emplace_back(table.GetPhenotypeID(context.phenotype));
+}
+
+//as above, with each build drawing from build_stream(build), e.g. a Philox4x32 keyed by the build index
+template<class Q, class Table, class StreamFactory>
+inline void AssembleBuilds(const InterfaceAdjacency& adjacency, Table& table, BuildContext& context, StreamFactory&& build_stream) {
+  context.pids.clear();
+  context.edge_usage.assign(adjacency.edge_pairs.size(),0);
+  
+  for(uint16_t build=0;build<Table::phenotype_builds;++build) {
+    auto&& rng=build_stream(build);
+    AssembleBuild<Q>(adjacency,table,context,rng);
+  }
+}
+
+//classification of a genotype from its builds, counting pids the same way as PhenotypeFrequencies, so the order of builds does not matter
+//unbound if UNBOUND_pid is common enough to be kept, deterministic if every build has the same (bound) pid and it is kept, and otherwise nondeterministic
+enum class BuildOutcome : uint8_t {Deterministic, Nondeterministic, Unbound};
+
+//builds a pid needs to be kept by PhenotypeFrequencies, at least one so a pid without builds is never kept
+template<class Table>
+inline uint16_t KeptBuildThreshold() {
+  return std::max<uint16_t>(1,std::ceil(Table::UND_threshold*Table::phenotype_builds));
+}
+
+inline BuildOutcome ClassifyBuilds(const std::vector<Phenotype_ID>& pids,const uint16_t thresh_val=KeptBuildThreshold<PhenotypeTable>()) {
+  const size_t unbound_builds=std::count(pids.begin(),pids.end(),UNBOUND_pid);
+  if(unbound_builds>=thresh_val)
+    return BuildOutcome::Unbound;
+  if(!unbound_builds && pids.size()>=thresh_val && std::all_of(pids.begin(),pids.end(),[&pids](const Phenotype_ID& pid){return pid==pids.front();}))
+    return BuildOutcome::Deterministic;
+  return BuildOutcome::Nondeterministic;
+}
+
+//assemble builds only until the classification is decided, giving the same outcome as ClassifyBuilds on the full set of builds
+//stops as unbound once enough builds are unbound, or as nondeterministic once builds differ and too few builds remain to keep UNBOUND_pid
+//deterministic genotypes still need every build
+//context.pids and context.edge_usage only cover the builds made, so a stopped genotype adds fewer undiscovered counts to the table than a full run,
+//and with UND_threshold above zero this can leave phenotypes unpromoted that AssembleBuilds would have promoted
+template<class Q, class Table, class StreamFactory>
+inline BuildOutcome AssembleBuildsUntilDecided(const InterfaceAdjacency& adjacency, Table& table, BuildContext& context, StreamFactory&& build_stream) {
+  context.pids.clear();
+  context.edge_usage.assign(adjacency.edge_pairs.size(),0);
+  const uint16_t thresh_val=KeptBuildThreshold<Table>();
+
+  uint16_t unbound_builds=0;
+  bool mixed_builds=false;
+  for(uint16_t build=0;build<Table::phenotype_builds;++build) {
+    auto&& rng=build_stream(build);
+    const Phenotype_ID pid=AssembleBuild<Q>(adjacency,table,context,rng);
+    unbound_builds+=pid==UNBOUND_pid;
+    mixed_builds=mixed_builds || pid!=context.pids.front();
+    if(unbound_builds>=thresh_val)
+      return BuildOutcome::Unbound;
+    const uint16_t remaining_builds=Table::phenotype_builds-build-1;
+    if((mixed_builds || unbound_builds) && unbound_builds+remaining_builds<thresh_val)
+      return BuildOutcome::Nondeterministic;
+  }
+  return ClassifyBuilds(context.pids,thresh_val);
+}
+
+template<class Q, class Table>
+inline BuildOutcome AssembleBuildsUntilDecided(const InterfaceAdjacency& adjacency, Table& table, BuildContext& context) {
+  return AssembleBuildsUntilDecided<Q>(adjacency,table,context,[](uint16_t) -> std::mt19937& {return RNG_Engine;});
+}
+
+//verdict of the static analysis of a genotype, where Unknown genotypes still need stochastic builds
+enum class AssemblyVerdict : uint8_t {Unknown, Deterministic, Unbound};
+
+//analyse the closure from every seed a build could start with, see PolyominoAssembly::AssemblyClosure
+//deterministic if every seed closes to the same phenotype, left in context.phenotype, and unbound if every seed is unbound
+template<class Q>
+inline AssemblyVerdict AnalyseAssembly(const InterfaceAdjacency& adjacency, BuildContext& context) {
+  const size_t seed_tiles=Q::free_seed && !adjacency.empty() ? adjacency.max_interface/4+1 : 1;
+  ClosureOutcome seed_outcome=ClosureOutcome::Unknown;
+
+  for(size_t seed_tile=0;seed_tile<seed_tiles;++seed_tile) {
+    const ClosureOutcome outcome=Q::AssemblyClosure(adjacency,static_cast<uint8_t>(1+4*seed_tile),context.closure);
+    if(outcome==ClosureOutcome::Unknown || (seed_tile && outcome!=seed_outcome))
+      return AssemblyVerdict::Unknown;
+    seed_outcome=outcome;
+    if(outcome==ClosureOutcome::Unbound)
+      continue;
+
+    if(!seed_tile) {
+      GetPhenotypeFromGrid(context.closure.placed_tiles,context.phenotype);
+      context.closure_edges=context.closure.used_edges;
+      context.fixed_edge_usage=context.closure.IsTree();
+      continue;
+    }
+    GetPhenotypeFromGrid(context.closure.placed_tiles,context.seed_phenotype);
+    if(!(context.seed_phenotype==context.phenotype))
+      return AssemblyVerdict::Unknown;
+    context.fixed_edge_usage=context.fixed_edge_usage && context.closure.IsTree() && context.closure.used_edges==context.closure_edges;
+  }
+  return seed_outcome==ClosureOutcome::Unbound ? AssemblyVerdict::Unbound : AssemblyVerdict::Deterministic;
+}
+
+//only assemble builds when static analysis cannot decide the genotype, otherwise filling pids and edge_usage as the builds would have
+//the phenotype is still classified once per build, so the table sees the same undiscovered counts as with full builds
+template<class Q, class Table, class StreamFactory>
+inline AssemblyVerdict AssembleBuildsAnalysed(const InterfaceAdjacency& adjacency, Table& table, BuildContext& context, StreamFactory&& build_stream) {
+  const AssemblyVerdict verdict=AnalyseAssembly<Q>(adjacency,context);
+  if(verdict==AssemblyVerdict::Unknown || (verdict==AssemblyVerdict::Deterministic && context.edge_usage_needed && !context.fixed_edge_usage)) {
+    AssembleBuilds<Q>(adjacency,table,context,std::forward<StreamFactory>(build_stream));
+    return verdict;
+  }
+
+  context.edge_usage.assign(adjacency.edge_pairs.size(),0);
+  if(verdict==AssemblyVerdict::Unbound) {
+    context.pids.assign(Table::phenotype_builds,UNBOUND_pid);
+    return verdict;
+  }
+  if(context.fixed_edge_usage)
+    for(uint32_t edge_index=0;edge_index<context.edge_usage.size();++edge_index)
+      context.edge_usage[edge_index]=Table::phenotype_builds*context.closure.EdgeUsed(edge_index);
+  context.pids.clear();
+  for(uint16_t build=0;build<Table::phenotype_builds;++build)
+    context.pids.emplace_back(table.GetPhenotypeID(context.phenotype));
+  return verdict;
+}
+
+template<class Q, class Table>
+inline AssemblyVerdict AssembleBuildsAnalysed(const InterfaceAdjacency& adjacency, Table& table, BuildContext& context) {
+  return AssembleBuildsAnalysed<Q>(adjacency,table,context,[](uint16_t) -> std::mt19937& {return RNG_Engine;});
+}
+
+//pid to fitness in one flat array, where each size bucket is a contiguous range starting at its offset
+//buckets keep spare capacity, so offsets only move (for every bucket at once) when one outgrows its range
+//pids outside the stored buckets, such as temporary, NULL or UNBOUND pids, have zero fitness
+struct DenseFitnessStore {
+  std::array<uint32_t,256> bucket_offsets{}, bucket_sizes{}, bucket_capacities{};
+  std::vector<double> fitnesses;
+
+  inline double operator[](Phenotype_ID pid) const {
+    return pid.second<bucket_sizes[pid.first] ? fitnesses[bucket_offsets[pid.first]+pid.second] : 0;
+  }
+
+  //copy in the fitnesses of every bucket, relaying out the array only if a bucket no longer fits
+  inline void Assign(const std::unordered_map<uint8_t,std::vector<double> >& phenotype_fitnesses) {
+    bool relayout=false;
+    for(const auto& kv : phenotype_fitnesses)
+      relayout|=kv.second.size()>bucket_capacities[kv.first];
+    
+    if(relayout) {
+      uint32_t offset=0;
+      for(uint16_t size=0;size<256;++size) {
+        auto fit_iter=phenotype_fitnesses.find(static_cast<uint8_t>(size));
+        const size_t needed=fit_iter==phenotype_fitnesses.end() ? 0 : fit_iter->second.size();
+        bucket_capacities[size]=needed<=bucket_capacities[size] ? bucket_capacities[size] : std::max<uint32_t>(2*needed,16);
+        bucket_offsets[size]=offset;
+        offset+=bucket_capacities[size];
+      }
+      fitnesses.assign(offset,0);
+    }
+    bucket_sizes.fill(0);
+    for(const auto& kv : phenotype_fitnesses) {
+      std::copy(kv.second.begin(),kv.second.end(),fitnesses.begin()+bucket_offsets[kv.first]);
+      bucket_sizes[kv.first]=kv.second.size();
+    }
+  }
+};
+
+//simple extension of a phenotype table to include fitnesses accessed via pid
+//fitnesses are edited in phenotype_fitnesses, and mirrored into a dense store for evaluation by SyncFitnesses
+//UpdateFitnesses and LoadTable sync, as does PopulationEvolution at every generation boundary, while other direct edits take effect at the next sync
+template<class Table>
+struct BasicFitnessPhenotypeTable : Table {
+  using Table::known_phenotypes;
+  using Table::phenotype_builds;
 
   //nondeterminism punishment (gamma) parameter
   inline static double fitness_factor=1;
@@ -14,6 +231,8 @@ struct FitnessPhenotypeTable : PhenotypeTable {
 
   //user defined fitness function, by default some random variable based on size
   std::function<double(uint8_t)> fit_func=[](double s) {return std::gamma_distribution<double>(s*2,.5*std::pow(s,-.5))(RNG_Engine);};
+  //as above, for seeded runs, drawing from the generator given rather than RNG_Engine
+  std::function<double(uint8_t,Philox4x32&)> seeded_fit_func=[](double s,Philox4x32& rng) {return std::gamma_distribution<double>(s*2,.5*std::pow(s,-.5))(rng);};
 
 
   //add as many new fitnesses as newly discovered phenotypes
@@ -21,47 +240,641 @@ struct FitnessPhenotypeTable : PhenotypeTable {
     for(const auto& kv : known_phenotypes)
       while(kv.second.size()>phenotype_fitnesses[kv.first].size())
         phenotype_fitnesses[kv.first].emplace_back(fit_func(kv.first));
+    SyncFitnesses();
   }
 
-  //sum over all phenotypes according to weighted fitness
-  inline double GenotypeFitness(std::map<Phenotype_ID,uint16_t> ID_counter) {
+  //as above, but reproducibly, with seeded_fit_func drawing from the stream of that pid, so its fitness depends only on the seed and the pid
+  inline void UpdateFitnesses(uint64_t seed) {
+    for(const auto& kv : known_phenotypes) {
+      std::vector<double>& fitnesses=phenotype_fitnesses[kv.first];
+      while(kv.second.size()>fitnesses.size()) {
+        Philox4x32 pid_stream(seed,Philox4x32::FITNESS_STREAM,kv.first,static_cast<uint32_t>(fitnesses.size()));
+        fitnesses.emplace_back(seeded_fit_func(kv.first,pid_stream));
+      }
+    }
+    SyncFitnesses();
+  }
+
+  //mirror phenotype_fitnesses into the dense store, and tabulate (k/phenotype_builds)^fitness_factor for every count k
+  inline void SyncFitnesses() {
+    fitness_store.Assign(phenotype_fitnesses);
+    commonness_weights.resize(phenotype_builds+1);
+    for(uint16_t commonness=0;commonness<=phenotype_builds;++commonness)
+      commonness_weights[commonness]=std::pow(static_cast<double>(commonness)/phenotype_builds,fitness_factor);
+    weights_builds=phenotype_builds;
+    weights_factor=fitness_factor;
+  }
+
+  //sum over (pid,count) pairs according to weighted fitness, from any flat or mapped range of counts
+  //only reads from the dense store, so is safe to call concurrently between syncs
+  template<typename CountIterator>
+  inline double GenotypeFitness(CountIterator first,CountIterator last) const {
     double fitness=0;
-    for(auto& kv : ID_counter)
-      fitness+=phenotype_fitnesses[kv.first.first][kv.first.second] * std::pow(static_cast<double>(kv.second)/phenotype_builds,fitness_factor);
+    for(;first!=last;++first)
+      fitness+=SingleFitness(first->first,first->second);
     return fitness;
   }
 
+  //sum over all phenotypes according to weighted fitness
+  inline double GenotypeFitness(const std::map<Phenotype_ID,uint16_t>& ID_counter) const {
+    return GenotypeFitness(ID_counter.begin(),ID_counter.end());
+  }
+  inline double GenotypeFitness(const std::vector<std::pair<Phenotype_ID,uint16_t> >& ID_counter) const {
+    return GenotypeFitness(ID_counter.begin(),ID_counter.end());
+  }
+
   //fitness based on a single given pid and its commonness
-  inline double SingleFitness(Phenotype_ID pid,uint16_t commonness) {
-    return phenotype_fitnesses[pid.first][pid.second] * std::pow(static_cast<double>(commonness)/phenotype_builds,fitness_factor);     
+  inline double SingleFitness(Phenotype_ID pid,uint16_t commonness) const {
+    if(commonness<commonness_weights.size() && weights_builds==phenotype_builds && weights_factor==fitness_factor)
+      return fitness_store[pid] * commonness_weights[commonness];
+    return fitness_store[pid] * std::pow(static_cast<double>(commonness)/phenotype_builds,fitness_factor);
   }
   
+  //drop every phenotype and its fitness
+  inline void ClearTable() {
+    Table::ClearTable();
+    phenotype_fitnesses={{0,{0}}};
+    SyncFitnesses();
+  }
+
   //load table normally, and then load in fitnesses
   inline void LoadTable(std::string f_name) {
-    PhenotypeTable::LoadTable(f_name);
+    Table::LoadTable(f_name);
     for(auto& kv : known_phenotypes)
       phenotype_fitnesses[kv.first].insert(phenotype_fitnesses[kv.first].end(),kv.second.size(),0); 
+    SyncFitnesses();
   }  
-    
+
+private:
+  DenseFitnessStore fitness_store;
+  std::vector<double> commonness_weights;
+  uint16_t weights_builds=0;
+  double weights_factor=0;
 };
 
+using FitnessPhenotypeTable = BasicFitnessPhenotypeTable<PhenotypeTable>;
+
+//fitness table that can be shared between threads, fitnesses should be updated at the generation boundary after relabelling
+using ConcurrentFitnessPhenotypeTable = BasicFitnessPhenotypeTable<ConcurrentPhenotypeTable>;
+
 //fitness proportional selection, or equal selection if net zero fitness
-inline std::vector<PopulationSize> RouletteWheelSelection(std::vector<double>& fitnesses) {
+template<typename URBG>
+inline std::vector<PopulationSize> RouletteWheelSelection(std::vector<double>& fitnesses, URBG& rng) {
+  POLYOMINO_METRIC_COUNT(Selections,1);
+  POLYOMINO_METRIC_TIMER(SelectionNanoseconds);
   std::vector<PopulationSize> selected_indices(fitnesses.size());
   std::partial_sum(fitnesses.begin(), fitnesses.end(), fitnesses.begin());
   
   //no fitness in population, select from all equally
   if(fitnesses.back()==0.) {
     std::uniform_int_distribution<PopulationSize> dist{0, static_cast<PopulationSize>(fitnesses.size()-1)};
-    std::generate(selected_indices.begin(),selected_indices.end(), [&dist](){return dist(RNG_Engine);});
+    std::generate(selected_indices.begin(),selected_indices.end(), [&dist,&rng](){return dist(rng);});
   }
   //select proportional to weighted fitness intervals
   else{ 
     std::uniform_real_distribution<double> random_interval(0,fitnesses.back());
     for(auto& sel_val : selected_indices) 
-      sel_val=static_cast<uint16_t>(std::lower_bound(fitnesses.begin(),fitnesses.end(),random_interval(RNG_Engine))-fitnesses.begin());
+      sel_val=static_cast<PopulationSize>(std::lower_bound(fitnesses.begin(),fitnesses.end(),random_interval(rng))-fitnesses.begin());
     std::sort(selected_indices.begin(),selected_indices.end());
   }
   
   return selected_indices;
 }
+
+inline std::vector<PopulationSize> RouletteWheelSelection(std::vector<double>& fitnesses) {
+  return RouletteWheelSelection(fitnesses,RNG_Engine);
+}
+
+//fixed set of worker threads for indexed tasks, with the calling thread joining in as worker 0
+//each worker starts on its own contiguous block of indices, and once that is exhausted steals the back half of another worker's block
+class WorkStealingPool {
+public:
+  explicit WorkStealingPool(size_t thread_count=std::thread::hardware_concurrency()) : worker_ranges(std::max<size_t>(thread_count,1)) {
+    for(size_t worker=1;worker<worker_ranges.size();++worker)
+      threads.emplace_back([this,worker]{WorkerLoop(worker);});
+  }
+  ~WorkStealingPool() {
+    {
+      std::lock_guard<std::mutex> lock(pool_mutex);
+      stopping=true;
+    }
+    start_signal.notify_all();
+    for(std::thread& worker_thread : threads)
+      worker_thread.join();
+  }
+  WorkStealingPool(const WorkStealingPool&)=delete;
+  WorkStealingPool& operator=(const WorkStealingPool&)=delete;
+
+  inline size_t WorkerCount() const {return worker_ranges.size();}
+
+  //run task(index,worker) for every index in [0,count), returning once all indices are complete
+  template<typename Task>
+  inline void ParallelFor(size_t count,Task&& task) {
+    if(count==0)
+      return;
+    const size_t workers=WorkerCount();
+    for(size_t worker=0;worker<workers;++worker)
+      worker_ranges[worker].range.store(PackRange(count*worker/workers,count*(worker+1)/workers),std::memory_order_relaxed);
+    current_task=std::forward<Task>(task);
+
+    {
+      std::lock_guard<std::mutex> lock(pool_mutex);
+      busy_workers=workers;
+      ++task_round;
+    }
+    start_signal.notify_all();
+    RunTasks(0);
+
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    finish_signal.wait(lock,[this]{return busy_workers==0;});
+    current_task=nullptr;
+  }
+
+private:
+  //[begin,end) index range packed into one word, so owner and thieves can both claim work with a single compare-exchange
+  struct alignas(64) PackedRange {
+    std::atomic<uint64_t> range{0};
+  };
+  std::vector<PackedRange> worker_ranges;
+  std::vector<std::thread> threads;
+  std::function<void(size_t,size_t)> current_task;
+
+  std::mutex pool_mutex;
+  std::condition_variable start_signal, finish_signal;
+  size_t busy_workers=0, task_round=0;
+  bool stopping=false;
+
+  static inline uint64_t PackRange(uint64_t begin,uint64_t end) {return begin<<32 | end;}
+  static inline uint64_t RangeBegin(uint64_t range) {return range>>32;}
+  static inline uint64_t RangeEnd(uint64_t range) {return range&0xffffffff;}
+
+  //take the next index from the front of a worker's own range
+  inline bool PopFront(size_t worker,size_t& index) {
+    uint64_t range=worker_ranges[worker].range.load(std::memory_order_acquire);
+    while(RangeBegin(range)<RangeEnd(range))
+      if(worker_ranges[worker].range.compare_exchange_weak(range,PackRange(RangeBegin(range)+1,RangeEnd(range)),std::memory_order_acq_rel)) {
+        index=RangeBegin(range);
+        return true;
+      }
+    return false;
+  }
+
+  //move the back half of the fullest other range into this worker's (empty) range
+  inline bool Steal(size_t worker) {
+    for(;;) {
+      size_t victim=worker;
+      uint64_t victim_range=0, most_remaining=0;
+      for(size_t other=0;other<WorkerCount();++other) {
+        const uint64_t range=worker_ranges[other].range.load(std::memory_order_acquire);
+        if(other!=worker && RangeEnd(range)-RangeBegin(range)>most_remaining && RangeBegin(range)<RangeEnd(range)) {
+          victim=other;
+          victim_range=range;
+          most_remaining=RangeEnd(range)-RangeBegin(range);
+        }
+      }
+      if(victim==worker)
+        return false;
+      const uint64_t split=RangeEnd(victim_range)-(most_remaining+1)/2;
+      if(worker_ranges[victim].range.compare_exchange_strong(victim_range,PackRange(RangeBegin(victim_range),split),std::memory_order_acq_rel)) {
+        worker_ranges[worker].range.store(PackRange(split,RangeEnd(victim_range)),std::memory_order_release);
+        return true;
+      }
+    }
+  }
+
+  inline void RunTasks(size_t worker) {
+    size_t index;
+    do {
+      while(PopFront(worker,index))
+        current_task(index,worker);
+    } while(Steal(worker));
+
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    if(--busy_workers==0)
+      finish_signal.notify_one();
+  }
+
+  inline void WorkerLoop(size_t worker) {
+    size_t seen_round=0;
+    for(;;) {
+      {
+        std::unique_lock<std::mutex> lock(pool_mutex);
+        start_signal.wait(lock,[this,seen_round]{return stopping || task_round!=seen_round;});
+        if(stopping)
+          return;
+        seen_round=task_round;
+      }
+      RunTasks(worker);
+    }
+  }
+};
+
+//how a new population is drawn from the fitnesses of the last
+enum class SelectionMode : uint8_t {Roulette, StochasticUniversal, Alias};
+
+//populations are split into fixed size blocks for the linear selection kernels, so results do not depend on how many threads run them
+constexpr size_t SELECTION_BLOCK_SIZE=1<<14;
+
+//run block_task(block) over every block, on the pool if one is given and there is more than one block
+template<typename BlockTask>
+inline void ForEachSelectionBlock(size_t block_count,WorkStealingPool* pool,BlockTask&& block_task) {
+  if(pool && block_count>1)
+    pool->ParallelFor(block_count,[&block_task](size_t block,size_t) {block_task(block);});
+  else
+    for(size_t block=0;block<block_count;++block)
+      block_task(block);
+}
+
+//stochastic universal sampling, with evenly spaced pointers from a single random offset, so O(N) and already sorted
+//selects every genotype once if net zero fitness
+template<typename URBG>
+inline std::vector<PopulationSize> StochasticUniversalSampling(const std::vector<double>& fitnesses, URBG& rng, WorkStealingPool* pool=nullptr) {
+  POLYOMINO_METRIC_COUNT(Selections,1);
+  POLYOMINO_METRIC_TIMER(SelectionNanoseconds);
+  const size_t population_size=fitnesses.size(), block_count=(population_size+SELECTION_BLOCK_SIZE-1)/SELECTION_BLOCK_SIZE;
+  std::vector<PopulationSize> selected_indices(population_size);
+
+  //cumulative fitness at the start of each block
+  std::vector<double> block_offsets(block_count+1,0);
+  ForEachSelectionBlock(block_count,pool,[&](size_t block) {
+      const auto block_start=fitnesses.begin()+block*SELECTION_BLOCK_SIZE;
+      block_offsets[block+1]=std::accumulate(block_start,block_start+std::min(SELECTION_BLOCK_SIZE,population_size-block*SELECTION_BLOCK_SIZE),0.);});
+  std::partial_sum(block_offsets.begin(),block_offsets.end(),block_offsets.begin());
+  const double total_fitness=block_offsets.back();
+
+  if(!(total_fitness>0)) {
+    std::iota(selected_indices.begin(),selected_indices.end(),0);
+    return selected_indices;
+  }
+
+  //pointer k sits at start+k*spacing, and the pointers before a cumulative fitness are counted the same way by neighbouring blocks
+  const double spacing=total_fitness/population_size;
+  const double start=std::uniform_real_distribution<double>(0,spacing)(rng);
+  auto pointers_before=[&](size_t block) -> size_t {
+    if(block==block_count)
+      return population_size;
+    return static_cast<size_t>(std::clamp(std::ceil((block_offsets[block]-start)/spacing),0.,static_cast<double>(population_size)));
+  };
+
+  ForEachSelectionBlock(block_count,pool,[&](size_t block) {
+      const size_t block_start=block*SELECTION_BLOCK_SIZE, block_end=std::min(block_start+SELECTION_BLOCK_SIZE,population_size);
+      size_t index=block_start, last_positive=block_start;
+      double cumulative=block_offsets[block]+fitnesses[index];
+      for(size_t pointer=pointers_before(block);pointer<pointers_before(block+1);++pointer) {
+        const double position=start+pointer*spacing;
+        while(index+1<block_end && cumulative<=position) {
+          if(fitnesses[index]>0)
+            last_positive=index;
+          cumulative+=fitnesses[++index];
+        }
+        //guard against rounding carrying a pointer past the block onto a trailing unfit genotype
+        if(fitnesses[index]>0)
+          last_positive=index;
+        selected_indices[pointer]=static_cast<PopulationSize>(last_positive);
+      }});
+  return selected_indices;
+}
+
+inline std::vector<PopulationSize> StochasticUniversalSampling(const std::vector<double>& fitnesses) {
+  return StochasticUniversalSampling(fitnesses,RNG_Engine);
+}
+
+//independent fitness proportional draws (as with the roulette wheel) using a Walker/Vose alias table, so O(1) per draw
+//draws are counted back into sorted order in O(N), and equal selection is used if net zero fitness
+//each block of draws uses its own Philox4x32 stream seeded from rng, so results are the same with or without a pool
+template<typename URBG>
+inline std::vector<PopulationSize> AliasSelection(const std::vector<double>& fitnesses, URBG& rng, WorkStealingPool* pool=nullptr) {
+  POLYOMINO_METRIC_COUNT(Selections,1);
+  POLYOMINO_METRIC_TIMER(SelectionNanoseconds);
+  const size_t population_size=fitnesses.size(), block_count=(population_size+SELECTION_BLOCK_SIZE-1)/SELECTION_BLOCK_SIZE;
+  std::vector<PopulationSize> selected_indices(population_size);
+  if(population_size==0)
+    return selected_indices;
+  const double total_fitness=std::accumulate(fitnesses.begin(),fitnesses.end(),0.);
+  const bool equal_selection=!(total_fitness>0);
+
+  //Vose's construction, scaled probabilities below 1 are topped up by an alias with a surplus
+  std::vector<double> probabilities(population_size,1);
+  std::vector<PopulationSize> aliases(population_size);
+  std::iota(aliases.begin(),aliases.end(),0);
+  if(!equal_selection) {
+    std::vector<PopulationSize> small, large;
+    for(size_t index=0;index<population_size;++index) {
+      probabilities[index]=fitnesses[index]*population_size/total_fitness;
+      (probabilities[index]<1 ? small : large).emplace_back(static_cast<PopulationSize>(index));
+    }
+    while(!small.empty() && !large.empty()) {
+      const PopulationSize under=small.back(), over=large.back();
+      small.pop_back();
+      aliases[under]=over;
+      probabilities[over]-=1-probabilities[under];
+      if(probabilities[over]<1) {
+        large.pop_back();
+        small.emplace_back(over);
+      }
+    }
+    //leftovers only differ from 1 by rounding
+    for(PopulationSize index : small)
+      probabilities[index]=1;
+    for(PopulationSize index : large)
+      probabilities[index]=1;
+  }
+
+  const uint64_t stream_seed=std::uniform_int_distribution<uint64_t>()(rng);
+  std::vector<PopulationSize> draws(population_size);
+  ForEachSelectionBlock(block_count,pool,[&](size_t block) {
+      Philox4x32 block_stream(stream_seed,0,0,static_cast<uint32_t>(block));
+      std::uniform_int_distribution<PopulationSize> random_index{0,static_cast<PopulationSize>(population_size-1)};
+      std::uniform_real_distribution<double> random_fraction(0,1);
+      for(size_t draw=block*SELECTION_BLOCK_SIZE;draw<std::min((block+1)*SELECTION_BLOCK_SIZE,population_size);++draw) {
+        const PopulationSize column=random_index(block_stream);
+        draws[draw]=random_fraction(block_stream)<probabilities[column] ? column : aliases[column];
+      }});
+
+  std::vector<PopulationSize> draw_counts(population_size,0);
+  for(PopulationSize draw : draws)
+    ++draw_counts[draw];
+  auto selected_iter=selected_indices.begin();
+  for(size_t index=0;index<population_size;++index)
+    selected_iter=std::fill_n(selected_iter,draw_counts[index],static_cast<PopulationSize>(index));
+  return selected_indices;
+}
+
+inline std::vector<PopulationSize> AliasSelection(const std::vector<double>& fitnesses) {
+  return AliasSelection(fitnesses,RNG_Engine);
+}
+
+//bounded map from canonical interaction graphs to the pids of their builds, so re-evaluating a genotype with an unchanged graph skips assembly
+//evicts with the CLOCK policy, where a hit only sets the slot's reference bit, and insertion sweeps a hand past referenced slots (clearing them) to the first unreferenced one
+//lookups share the lock and run in parallel, insertions take it exclusively
+//only builds whose pids are all known or unbound are admitted, as temporary pids are renumbered by RelabelPIDs and dropped by ClearIncomplete,
+//so entries never need invalidating when the table relabels; Clear the cache if known phenotypes are ever removed or reordered
+//the cached pids are only meaningful for the table they were inserted with, so a cache must not be used with more than one table
+class AssemblyCache {
+public:
+  struct Statistics {
+    uint64_t hits=0, misses=0, insertions=0, evictions=0, rejections=0;
+    double HitRate() const {return hits+misses ? static_cast<double>(hits)/(hits+misses) : 0;}
+  };
+
+  explicit AssemblyCache(size_t capacity) : slots(std::max<size_t>(capacity,1)) {}
+
+  //copy the cached pids of a graph into pids, returning false if it is not cached
+  inline bool Find(const InteractionGraphKey& key, std::vector<Phenotype_ID>& pids) {
+    std::shared_lock<std::shared_mutex> read_lock(cache_mutex);
+    auto [match,last_match]=slot_index.equal_range(key.hash);
+    for(;match!=last_match;++match)
+      if(Slot& slot=slots[match->second]; slot.key==key) {
+        slot.referenced.store(true,std::memory_order_relaxed);
+        pids.assign(slot.pids.begin(),slot.pids.end());
+        hits.fetch_add(1,std::memory_order_relaxed);
+        return true;
+      }
+    misses.fetch_add(1,std::memory_order_relaxed);
+    return false;
+  }
+
+  //cache the relabelled pids of a graph, returning false if they were not admitted or the graph is already cached
+  template<class Table>
+  inline bool Insert(const InteractionGraphKey& key, const std::vector<Phenotype_ID>& pids, const Table& table) {
+    if(!std::all_of(pids.begin(),pids.end(),[&table](const Phenotype_ID& pid){return pid==UNBOUND_pid || table.IsKnown(pid);})) {
+      rejections.fetch_add(1,std::memory_order_relaxed);
+      return false;
+    }
+
+    std::unique_lock<std::shared_mutex> write_lock(cache_mutex);
+    auto [match,last_match]=slot_index.equal_range(key.hash);
+    for(;match!=last_match;++match)
+      if(slots[match->second].key==key)
+        return false;
+
+    for(;slots[hand].occupied && slots[hand].referenced.exchange(false,std::memory_order_relaxed);hand=(hand+1)%slots.size());
+    Slot& slot=slots[hand];
+    if(slot.occupied) {
+      for(auto [evicted,last_evicted]=slot_index.equal_range(slot.key.hash);evicted!=last_evicted;++evicted)
+        if(evicted->second==hand) {
+          slot_index.erase(evicted);
+          break;
+        }
+      evictions.fetch_add(1,std::memory_order_relaxed);
+    }
+    slot.key=key;
+    slot.pids.assign(pids.begin(),pids.end());
+    slot.occupied=true;
+    slot_index.emplace(key.hash,hand);
+    hand=(hand+1)%slots.size();
+    insertions.fetch_add(1,std::memory_order_relaxed);
+    return true;
+  }
+
+  //drop every entry, keeping the statistics
+  inline void Clear() {
+    std::unique_lock<std::shared_mutex> write_lock(cache_mutex);
+    for(Slot& slot : slots) {
+      slot.occupied=false;
+      slot.referenced.store(false,std::memory_order_relaxed);
+    }
+    slot_index.clear();
+    hand=0;
+  }
+
+  inline Statistics GetStatistics() const {
+    return Statistics{hits.load(),misses.load(),insertions.load(),evictions.load(),rejections.load()};
+  }
+  inline size_t size() const {
+    std::shared_lock<std::shared_mutex> read_lock(cache_mutex);
+    return slot_index.size();
+  }
+  inline size_t capacity() const {return slots.size();}
+
+private:
+  struct Slot {
+    InteractionGraphKey key;
+    std::vector<Phenotype_ID> pids;
+    std::atomic<bool> referenced{false};
+    bool occupied=false;
+  };
+
+  std::vector<Slot> slots;
+  std::unordered_multimap<uint64_t,size_t> slot_index;
+  size_t hand=0;
+  mutable std::shared_mutex cache_mutex;
+  std::atomic<uint64_t> hits{0}, misses{0}, insertions{0}, evictions{0}, rejections{0};
+};
+
+//one population evolving under a genotype model Q, with genotype evaluation spread over a work-stealing pool
+//each generation mutates and assembles every genotype in parallel against a shared concurrent table (one BuildContext per worker),
+//then after the barrier merges newly discovered phenotypes, updates fitnesses, and selects the next population on the calling thread
+//given a seed, every draw comes from a Philox4x32 stream keyed by (seed, generation, genotype, build), so runs are identical for any thread count,
+//as long as mutations take the generator they are given, i.e. mutate(genotype,rng), rather than using RNG_Engine
+template<class Q, class Genotype, class Table=ConcurrentFitnessPhenotypeTable>
+class PopulationEvolution {
+  static_assert(std::is_base_of<ConcurrentPhenotypeTable,Table>::value,"parallel evaluation needs a table derived from ConcurrentPhenotypeTable");
+
+public:
+  std::vector<Genotype> genotypes;
+  std::vector<double> fitnesses;
+
+  //relabelled pids of every build of each genotype in the last evaluated generation, where phenotypes too rare to be promoted are NULL_pid
+  std::vector<std::vector<Phenotype_ID>> genotype_pids;
+
+  //generations completed, used as the stream index in seeded runs
+  uint32_t generation=0;
+  SelectionMode selection_mode=SelectionMode::Roulette;
+
+  //if set, genotypes are first analysed statically (see AssembleBuildsAnalysed) and decided ones skip their builds
+  //this only pays off when many genotypes are unbound or deterministic, otherwise the analysis is extra work for every genotype
+  bool static_analysis=false;
+
+  //if set, genotype_interactions holds the interactions used by any build of each genotype in the last evaluated generation
+  //this needs the edge usage of every genotype, so the assembly cache is not read, and statically deterministic genotypes are built unless their edge usage is fixed
+  bool collect_interactions=false;
+  std::vector<std::set<InteractionPair>> genotype_interactions;
+
+  //optional cache of build pids by interaction graph, so neutral mutations skip assembly
+  //the pids are those of this population's table, so only populations classifying against the same table may share a cache
+  //cached genotypes reuse earlier builds rather than drawing new ones, so seeded runs with a cache differ from those without, but not between thread counts
+  AssemblyCache* assembly_cache=nullptr;
+
+  PopulationEvolution(Table& shared_table,std::vector<Genotype> initial_genotypes,size_t thread_count=std::thread::hardware_concurrency()) :
+    genotypes(std::move(initial_genotypes)), table(shared_table), pool(thread_count), contexts(pool.WorkerCount()) {}
+  PopulationEvolution(Table& shared_table,std::vector<Genotype> initial_genotypes,size_t thread_count,uint64_t seed) :
+    PopulationEvolution(shared_table,std::move(initial_genotypes),thread_count) {
+    rng_seed=seed;
+    seeded=true;
+  }
+
+  //assign every genotype its fitness, without mutation or selection
+  inline void EvaluatePopulation() {
+    Evaluate([](Genotype&){});
+    ++generation;
+  }
+
+  //mutate, evaluate, and select a new population, returning the parent index of each new genotype
+  template<typename Mutation>
+  inline std::vector<PopulationSize> Generation(Mutation&& mutate) {
+    return Generation(std::forward<Mutation>(mutate),[](const PopulationEvolution&){});
+  }
+
+  //as above, calling evaluated(*this) between evaluation and selection, e.g. to record the generation
+  //only then do genotypes, fitnesses, and genotype_pids all describe the same population, with generation still its index
+  template<typename Mutation, typename Evaluated>
+  inline std::vector<PopulationSize> Generation(Mutation&& mutate,Evaluated&& evaluated) {
+    Evaluate(std::forward<Mutation>(mutate));
+    evaluated(static_cast<const PopulationEvolution&>(*this));
+    const std::vector<PopulationSize> selected_indices=Select();
+
+    std::vector<Genotype> offspring;
+    offspring.reserve(genotypes.size());
+    for(PopulationSize parent : selected_indices)
+      offspring.emplace_back(genotypes[parent]);
+    genotypes.swap(offspring);
+    ++generation;
+    return selected_indices;
+  }
+
+private:
+  Table& table;
+  WorkStealingPool pool;
+  std::vector<BuildContext> contexts;
+  std::vector<InteractionGraphKey> genotype_keys;
+  std::vector<uint8_t> cached;
+  uint64_t rng_seed=0;
+  bool seeded=false;
+
+  inline std::vector<PopulationSize> Select() {
+    Philox4x32 selection_stream(seeded ? rng_seed : RNG_Engine(),generation,Philox4x32::SELECTION_STREAM);
+    switch(selection_mode) {
+    case SelectionMode::StochasticUniversal:
+      return StochasticUniversalSampling(fitnesses,selection_stream,&pool);
+    case SelectionMode::Alias:
+      return AliasSelection(fitnesses,selection_stream,&pool);
+    case SelectionMode::Roulette:
+      [[fallthrough]];
+    default:
+      std::vector<double> selection_weights(fitnesses);
+      return seeded ? RouletteWheelSelection(selection_weights,selection_stream) : RouletteWheelSelection(selection_weights);
+    }
+  }
+
+  template<typename Mutation>
+  inline void Evaluate(Mutation&& mutate) {
+    genotype_pids.resize(genotypes.size());
+    fitnesses.assign(genotypes.size(),0);
+    genotype_keys.resize(genotypes.size());
+    cached.assign(genotypes.size(),false);
+    genotype_interactions.resize(collect_interactions ? genotypes.size() : 0);
+    //unless interactions are collected only pids are kept from the builds, so analysed genotypes never need building just for their edge usage
+    for(BuildContext& context : contexts)
+      context.edge_usage_needed=collect_interactions;
+
+    pool.ParallelFor(genotypes.size(),[this,&mutate](size_t index,size_t worker) {
+      const uint32_t genotype_index=static_cast<uint32_t>(index);
+      if constexpr(std::is_invocable<Mutation&,Genotype&,Philox4x32&>::value) {
+        Philox4x32 mutation_stream(seeded ? rng_seed : RNG_Engine(),generation,genotype_index,Philox4x32::MUTATION_STREAM);
+        mutate(genotypes[index],mutation_stream);
+      }
+      else
+        mutate(genotypes[index]);
+
+      BuildContext& context=contexts[worker];
+      Q::GetActiveInterfaces(genotypes[index],context.edges);
+      if(assembly_cache) {
+        CanonicalInteractionGraph(context.edges,Q::free_seed,genotype_keys[index]);
+        if(!collect_interactions && assembly_cache->Find(genotype_keys[index],genotype_pids[index])) {
+          cached[index]=true;
+          return;
+        }
+      }
+
+      context.adjacency.Assign(context.edges);
+      const auto build_stream=[this,genotype_index](uint16_t build) {return Philox4x32(rng_seed,generation,genotype_index,build);};
+      if(static_analysis) {
+        if(seeded)
+          AssembleBuildsAnalysed<Q>(context.adjacency,table,context,build_stream);
+        else
+          AssembleBuildsAnalysed<Q>(context.adjacency,table,context);
+      }
+      else {
+        if(seeded)
+          AssembleBuilds<Q>(context.adjacency,table,context,build_stream);
+        else
+          AssembleBuilds<Q>(context.adjacency,table,context);
+      }
+      genotype_pids[index].assign(context.pids.begin(),context.pids.end());
+      if(collect_interactions) {
+        genotype_interactions[index].clear();
+        for(uint32_t edge_index=0;edge_index<context.adjacency.edge_pairs.size();++edge_index)
+          if(context.edge_usage[edge_index])
+            genotype_interactions[index].insert(context.adjacency.edge_pairs[edge_index]);
+      }
+    });
+
+    //barrier reached, so the table can be merged and fitnesses assigned in a fixed order
+    //temporary pids that were not promoted depend on the order phenotypes were discovered in, so are all counted as the rare NULL_pid
+    for(std::vector<Phenotype_ID>& pids : genotype_pids) {
+      table.RelabelPIDs(pids);
+      for(Phenotype_ID& pid : pids)
+        if(pid!=UNBOUND_pid && !table.IsKnown(pid))
+          pid=NULL_pid;
+    }
+    //inserted in genotype order at the barrier, so the cache contents do not depend on thread scheduling
+    if(assembly_cache)
+      for(size_t index=0;index<genotypes.size();++index)
+        if(!cached[index])
+          assembly_cache->Insert(genotype_keys[index],genotype_pids[index],table);
+    table.ClearIncomplete();
+    if(seeded)
+      table.UpdateFitnesses(rng_seed);
+    else
+      table.UpdateFitnesses();
+
+    //counting and fitness only read the table, so are spread over the pool again
+    pool.ParallelFor(genotypes.size(),[this](size_t index,size_t) {
+      thread_local std::vector<std::pair<Phenotype_ID,uint16_t> > ID_counts;
+      table.PhenotypeFrequencies(genotype_pids[index],ID_counts);
+      auto unbound_iter=std::remove_if(ID_counts.begin(),ID_counts.end(),[](const auto& entry){return entry.first==UNBOUND_pid;});
+      fitnesses[index]=table.GenotypeFitness(ID_counts.begin(),unbound_iter);
+    });
+  }
+};
@@ -8,7 +8,13 @@
 #include <array>
 #include <random>
 #include <functional>
+#include <numeric>
+#include <climits>
+#include "core_kernels.hpp"
+#include "core_random.hpp"
+#include "core_metrics.hpp"
 
+//default per-thread generator, for reproducible runs pass a Philox4x32 stream to the methods taking a generator instead
 thread_local static inline std::mt19937 RNG_Engine(std::random_device{}());
 
 //interaction indicies within a genotype
@@ -20,6 +26,418 @@ struct PotentialTileSites {
   std::vector<std::pair<InteractionPair,std::array<int8_t,3>>> sites;
   
   std::vector<double> strengths;
+
+  inline void Add(const InteractionPair& edge,const std::array<int8_t,3>& site,double strength,uint32_t=0) {
+    sites.emplace_back(edge,site);
+    strengths.emplace_back(strength);
+  }
+};
+
+//perimeter options with their strengths held in a Fenwick tree, so weighted sampling, insertion and removal by location are O(log P)
+//removed options are left as zero strength tombstones, and compacted away once they outnumber the live options
+struct WeightedTileSites {
+  //array with x position, y position, and rotation, indices are stable until compaction
+  std::vector<std::pair<InteractionPair,std::array<int8_t,3>>> sites;
+  
+  std::vector<double> strengths;
+
+  //position of each option's edge in the edge list
+  std::vector<uint32_t> edge_indices;
+
+  WeightedTileSites(void) {Clear();}
+
+  inline bool empty() const {return live_sites==0;}
+  inline size_t size() const {return live_sites;}
+
+  //empty the options, keeping allocated memory for the next assembly
+  inline void Clear() {
+    sites.clear();
+    strengths.clear();
+    edge_indices.clear();
+    next_at_location.clear();
+    strength_tree.assign(1,0.);
+    ResetHeads();
+    live_sites=0;
+  }
+
+  inline void Add(const InteractionPair& edge,const std::array<int8_t,3>& site,double strength,uint32_t edge_index=0) {
+    const uint32_t site_index=static_cast<uint32_t>(sites.size());
+    sites.emplace_back(edge,site);
+    strengths.emplace_back(strength);
+    edge_indices.emplace_back(edge_index);
+
+    //a new Fenwick node covers itself and the nodes below it up to its lowest set bit
+    const size_t node=site_index+1;
+    double node_strength=strength;
+    for(size_t child=1;child<(node&(~node+1));child<<=1)
+      node_strength+=strength_tree[node-child];
+    strength_tree.emplace_back(node_strength);
+
+    //chain onto other options at the same location
+    uint32_t& head=LocationHead(site[0],site[1]);
+    next_at_location.emplace_back(head);
+    head=site_index;
+    ++live_sites;
+  }
+
+  //index of an option chosen proportional to strength, same distribution as a lower_bound over the strength cdf
+  template<typename URBG>
+  inline size_t Sample(URBG& rng) const {
+    const size_t tree_size=sites.size();
+    std::uniform_real_distribution<double> random_interval(0,PrefixStrength(tree_size));
+    double remaining=random_interval(rng);
+
+    size_t position=0;
+    for(size_t step=HighestPower(tree_size);step;step>>=1)
+      if(position+step<=tree_size && strength_tree[position+step]<=remaining) {
+        position+=step;
+        remaining-=strength_tree[position];
+      }
+
+    //rounding in the tree can land on a tombstone or past the end, so take the nearest live option
+    while(position<tree_size && strengths[position]==0)
+      ++position;
+    while(position==tree_size || strengths[position]==0)
+      --position;
+    return position;
+  }
+
+  //remove every option at a location
+  inline void RemoveLocation(int8_t x,int8_t y) {
+    uint32_t& head=LocationHead(x,y);
+    for(uint32_t site_index=head;site_index!=NO_SITE;site_index=next_at_location[site_index]) {
+      if(strengths[site_index]==0)
+        continue;
+      for(size_t node=site_index+1;node<strength_tree.size();node+=node&(~node+1))
+        strength_tree[node]-=strengths[site_index];
+      strengths[site_index]=0;
+      --live_sites;
+    }
+    head=NO_SITE;
+
+    if(sites.size()>=MIN_COMPACTION && sites.size()>2*live_sites)
+      Compact();
+  }
+
+private:
+  static constexpr uint32_t NO_SITE=UINT32_MAX;
+  static constexpr size_t MIN_HEADS=16, MIN_COMPACTION=64;
+
+  std::vector<double> strength_tree;
+  std::vector<uint32_t> next_at_location;
+
+  //open addressing table from packed location to the most recent option there
+  std::vector<std::pair<uint32_t,uint32_t>> location_heads;
+  size_t live_sites=0, used_heads=0;
+
+  inline void ResetHeads() {
+    if(location_heads.empty())
+      location_heads.assign(MIN_HEADS,{NO_SITE,NO_SITE});
+    else if(used_heads)
+      std::fill(location_heads.begin(),location_heads.end(),std::make_pair(NO_SITE,NO_SITE));
+    used_heads=0;
+  }
+
+  static inline size_t HighestPower(size_t value) {
+    size_t power=1;
+    while(power<=value/2)
+      power<<=1;
+    return value ? power : 0;
+  }
+
+  inline double PrefixStrength(size_t node) const {
+    double prefix=0;
+    for(;node;node&=node-1)
+      prefix+=strength_tree[node];
+    return prefix;
+  }
+
+  inline uint32_t& LocationHead(int8_t x,int8_t y) {
+    const uint32_t location=static_cast<uint32_t>(static_cast<uint8_t>(x))<<8 | static_cast<uint8_t>(y);
+    if(2*(used_heads+1)>location_heads.size())
+      GrowHeads();
+    const size_t mask=location_heads.size()-1;
+    for(size_t slot=(location*2654435761u)&mask;;slot=(slot+1)&mask) {
+      if(location_heads[slot].first==location)
+        return location_heads[slot].second;
+      if(location_heads[slot].first==NO_SITE) {
+        ++used_heads;
+        location_heads[slot].first=location;
+        return location_heads[slot].second;
+      }
+    }
+  }
+
+  inline void GrowHeads() {
+    std::vector<std::pair<uint32_t,uint32_t>> old_heads(2*location_heads.size(),{NO_SITE,NO_SITE});
+    old_heads.swap(location_heads);
+    const size_t mask=location_heads.size()-1;
+    for(const auto& [location,head] : old_heads)
+      if(location!=NO_SITE)
+        for(size_t slot=(location*2654435761u)&mask;;slot=(slot+1)&mask)
+          if(location_heads[slot].first==NO_SITE) {
+            location_heads[slot]={location,head};
+            break;
+          }
+  }
+
+  //drop tombstones in place, keeping the live options in order, and rebuild the tree and location chains
+  inline void Compact() {
+    size_t live_index=0;
+    for(size_t site_index=0;site_index<sites.size();++site_index)
+      if(strengths[site_index]!=0) {
+        sites[live_index]=sites[site_index];
+        strengths[live_index]=strengths[site_index];
+        edge_indices[live_index++]=edge_indices[site_index];
+      }
+    sites.resize(live_index);
+    strengths.resize(live_index);
+    edge_indices.resize(live_index);
+
+    //linear time Fenwick construction, each node passing its total to its parent
+    strength_tree.assign(live_index+1,0.);
+    for(size_t node=1;node<=live_index;++node) {
+      strength_tree[node]+=strengths[node-1];
+      if(const size_t parent=node+(node&(~node+1)); parent<=live_index)
+        strength_tree[parent]+=strength_tree[node];
+    }
+
+    ResetHeads();
+    next_at_location.resize(live_index);
+    for(uint32_t site_index=0;site_index<live_index;++site_index) {
+      uint32_t& head=LocationHead(sites[site_index].second[0],sites[site_index].second[1]);
+      next_at_location[site_index]=head;
+      head=site_index;
+    }
+  }
+};
+
+//dense occupancy bitmap over the whole int8_t coordinate range, so checking a lattice site is constant time
+struct OccupancyGrid {
+  std::array<uint64_t,1024> occupied_bits{};
+
+  static inline size_t SiteIndex(int8_t x,int8_t y) {return static_cast<size_t>(static_cast<uint8_t>(x))<<8 | static_cast<uint8_t>(y);}
+
+  inline bool IsOccupied(int8_t x,int8_t y) const {
+    const size_t site=SiteIndex(x,y);
+    return occupied_bits[site>>6] >> (site&63) & 1;
+  }
+  inline void Occupy(int8_t x,int8_t y) {
+    const size_t site=SiteIndex(x,y);
+    occupied_bits[site>>6] |= uint64_t(1) << (site&63);
+  }
+
+  //clear only the words holding the sites of a placed tile vector, cheaper than wiping the grid for small assemblies
+  inline void Release(const std::vector<int8_t>& placed_tiles) {
+    for(size_t tile_index=0;tile_index<placed_tiles.size();tile_index+=3)
+      occupied_bits[SiteIndex(placed_tiles[tile_index],placed_tiles[tile_index+1])>>6]=0;
+  }
+};
+
+//edges of the assembly graph grouped by interface in compressed sparse row form, so the partners of an interface are one contiguous range
+//built once per genotype, partners of each interface keep the order of the edge list
+struct InterfaceAdjacency {
+  struct Partner {
+    InteractionPair edge;
+    size_t partner_interface;
+    double strength;
+    uint32_t edge_index;
+  };
+
+  std::vector<uint32_t> offsets;
+  std::vector<Partner> partners;
+  std::vector<InteractionPair> edge_pairs;
+  size_t max_interface=0;
+
+  InterfaceAdjacency(void) : offsets{0} {}
+  explicit InterfaceAdjacency(const std::vector<std::pair<InteractionPair,double> >& edges) {Assign(edges);}
+
+  //rebuild for a new edge list, reusing the storage of the previous one
+  inline void Assign(const std::vector<std::pair<InteractionPair,double> >& edges) {
+    max_interface=0;
+    for(const auto& edge : edges)
+      max_interface=std::max(max_interface,std::max(edge.first.first,edge.first.second));
+
+    //count partners for each interface, self-interactions only appear once
+    offsets.assign(edges.empty() ? 1 : max_interface+2,0);
+    for(const auto& edge : edges) {
+      ++offsets[edge.first.first+1];
+      if(edge.first.second!=edge.first.first)
+        ++offsets[edge.first.second+1];
+    }
+    std::partial_sum(offsets.begin(),offsets.end(),offsets.begin());
+
+    //fill each interface range in edge order, using offsets as the fill positions, which leaves each one at the start of the next range
+    edge_pairs.clear();
+    for(const auto& edge : edges)
+      edge_pairs.emplace_back(edge.first);
+    partners.resize(offsets.back());
+    for(uint32_t edge_index=0;edge_index<edges.size();++edge_index) {
+      const auto& [edge,strength]=edges[edge_index];
+      partners[offsets[edge.first]++]=Partner{edge,edge.second,strength,edge_index};
+      if(edge.second!=edge.first)
+        partners[offsets[edge.second]++]=Partner{edge,edge.first,strength,edge_index};
+    }
+    std::copy_backward(offsets.begin(),offsets.end()-1,offsets.end());
+    offsets.front()=0;
+  }
+
+  inline bool empty() const {return partners.empty();}
+
+  //range of partners for an interface, empty if the interface has no edges
+  inline std::pair<const Partner*,const Partner*> PartnersOf(size_t interface_index) const {
+    if(interface_index+1>=offsets.size())
+      return {nullptr,nullptr};
+    return {partners.data()+offsets[interface_index],partners.data()+offsets[interface_index+1]};
+  }
+};
+
+//interaction graph of a genotype relabelled into a canonical subunit order, so genotypes only differing in subunit order share a key
+//assembly also depends on how many subunits can seed it and whether the seed is free, so these are part of the key
+struct InteractionGraphKey {
+  std::vector<std::pair<InteractionPair,double> > edges;
+  size_t subunits=0;
+  bool free_seed=true;
+  uint64_t hash=0;
+
+  bool operator==(const InteractionGraphKey& rhs) const {return hash==rhs.hash && subunits==rhs.subunits && free_seed==rhs.free_seed && edges==rhs.edges;}
+};
+
+//subunits are ordered by the sorted (face, partner face, strength) of their edges, with ties broken by the smallest relabelled edge list
+//only subunit 0 can seed a fixed seed assembly, so it keeps its label; subunits without edges never appear in the key, so their order is never tried
+//a tie that would take the orderings past MAX_TIE_ORDERINGS keeps its given order, which still gives a valid key, but relabelled copies of that graph may not share it
+inline void CanonicalInteractionGraph(const std::vector<std::pair<InteractionPair,double> >& edges, bool free_seed, InteractionGraphKey& key) {
+  constexpr size_t MAX_TIE_ORDERINGS=720;
+  using FaceSignature=std::vector<std::tuple<uint8_t,uint8_t,double,bool> >;
+  thread_local std::vector<FaceSignature> signatures;
+  thread_local std::vector<size_t> order,labels;
+  thread_local std::vector<std::pair<size_t,size_t> > ties;
+  thread_local std::vector<std::pair<InteractionPair,double> > relabelled_edges;
+
+  key.free_seed=free_seed;
+  key.edges.clear();
+  size_t max_interface=0;
+  for(const auto& edge : edges)
+    max_interface=std::max(max_interface,edge.first.second);
+  key.subunits=edges.empty() ? 0 : max_interface/4+1;
+
+  signatures.assign(key.subunits,{});
+  for(const auto& [edge,strength] : edges) {
+    signatures[edge.first/4].emplace_back(edge.first%4,edge.second%4,strength,edge.first/4==edge.second/4);
+    if(edge.first!=edge.second)
+      signatures[edge.second/4].emplace_back(edge.second%4,edge.first%4,strength,edge.first/4==edge.second/4);
+  }
+  for(FaceSignature& signature : signatures)
+    std::sort(signature.begin(),signature.end());
+
+  const size_t pinned=!free_seed && key.subunits;
+  order.resize(key.subunits);
+  std::iota(order.begin(),order.end(),0);
+  std::stable_sort(order.begin()+pinned,order.end(),[](size_t left,size_t right){return signatures[left]<signatures[right];});
+
+  //runs of equal signatures, and how many orderings they allow in total
+  ties.clear();
+  size_t orderings=1;
+  for(size_t run_start=pinned;run_start<order.size();) {
+    size_t run_end=run_start+1;
+    while(run_end<order.size() && signatures[order[run_end]]==signatures[order[run_start]])
+      ++run_end;
+    size_t run_orderings=1;
+    for(size_t factor=2;factor<=run_end-run_start && orderings*run_orderings<=MAX_TIE_ORDERINGS;++factor)
+      run_orderings*=factor;
+    if(run_orderings>1 && !signatures[order[run_start]].empty() && orderings*run_orderings<=MAX_TIE_ORDERINGS) {
+      ties.emplace_back(run_start,run_end);
+      orderings*=run_orderings;
+    }
+    run_start=run_end;
+  }
+
+  //try every ordering within the ties, stepping through them like an odometer
+  labels.resize(key.subunits);
+  bool first_ordering=true;
+  for(bool next_ordering=true;next_ordering;) {
+    for(size_t position=0;position<order.size();++position)
+      labels[order[position]]=position;
+    relabelled_edges.clear();
+    for(const auto& [edge,strength] : edges) {
+      const size_t first=labels[edge.first/4]*4+edge.first%4,second=labels[edge.second/4]*4+edge.second%4;
+      relabelled_edges.emplace_back(InteractionPair{std::min(first,second),std::max(first,second)},strength);
+    }
+    std::sort(relabelled_edges.begin(),relabelled_edges.end());
+    if(first_ordering || relabelled_edges<key.edges)
+      key.edges.swap(relabelled_edges);
+    first_ordering=false;
+
+    next_ordering=false;
+    for(auto tie=ties.rbegin();tie!=ties.rend() && !next_ordering;++tie)
+      next_ordering=std::next_permutation(order.begin()+tie->first,order.begin()+tie->second);
+  }
+
+  key.hash=key.subunits*2+free_seed;
+  for(const auto& [edge,strength] : key.edges)
+    key.hash=(key.hash*0x100000001b3)^(edge.first<<8 | edge.second)^(std::hash<double>{}(strength)<<16);
+}
+
+//reusable buffers for repeated assembly, so builds after the first one do not allocate
+//after a build, holds the placed tiles and a bitset over the edge indices used in that build
+struct AssemblyContext {
+  std::vector<int8_t> placed_tiles;
+  std::vector<uint64_t> used_edges;
+  OccupancyGrid occupied_sites;
+  WeightedTileSites perimeter_sites;
+
+  //clear state from the previous build, sizing the edge bitset for this genotype
+  inline void Reset(const InterfaceAdjacency& adjacency) {
+    occupied_sites.Release(placed_tiles);
+    placed_tiles.clear();
+    perimeter_sites.Clear();
+    used_edges.assign((adjacency.edge_pairs.size()+63)/64,0);
+  }
+
+  inline void MarkEdge(uint32_t edge_index) {used_edges[edge_index>>6] |= uint64_t(1) << (edge_index&63);}
+  inline bool EdgeUsed(uint32_t edge_index) const {return used_edges[edge_index>>6] >> (edge_index&63) & 1;}
+
+  //edges used in the last build, as interacting index pairs
+  inline std::set<InteractionPair> InteractingIndices(const InterfaceAdjacency& adjacency) const {
+    std::set<InteractionPair> interacting_indices;
+    for(uint32_t edge_index=0;edge_index<adjacency.edge_pairs.size();++edge_index)
+      if(EdgeUsed(edge_index))
+        interacting_indices.insert(adjacency.edge_pairs[edge_index]);
+    return interacting_indices;
+  }
+};
+
+//outcome of exploring the closure of a seed, Unknown if it cannot stand in for stochastic builds
+enum class ClosureOutcome : uint8_t {Unknown, Bounded, Unbound};
+
+//reusable buffers for exploring every offer from a seed at once, rather than sampling one assembly order
+//site_details holds the tile offered to each lattice site, and distances the number of bonds from the seed to each placed tile
+struct ClosureContext {
+  std::vector<int8_t> placed_tiles;
+  std::vector<uint32_t> distances;
+  std::vector<uint64_t> used_edges;
+  std::vector<uint8_t> site_details=std::vector<uint8_t>(size_t(1)<<16,0);
+  std::vector<std::pair<std::array<int8_t,3>,uint32_t> > offers;
+  size_t bond_offers=0;
+
+  inline void Reset(const InterfaceAdjacency& adjacency) {
+    for(size_t tile_index=0;tile_index<placed_tiles.size();tile_index+=3)
+      site_details[OccupancyGrid::SiteIndex(placed_tiles[tile_index],placed_tiles[tile_index+1])]=0;
+    placed_tiles.clear();
+    distances.clear();
+    used_edges.assign((adjacency.edge_pairs.size()+63)/64,0);
+    bond_offers=0;
+  }
+
+  //collects offers in the same form as the perimeter sites of an assembly
+  inline void Add(const InteractionPair&,const std::array<int8_t,3>& site,double,uint32_t edge_index) {offers.emplace_back(site,edge_index);}
+
+  inline void MarkEdge(uint32_t edge_index) {used_edges[edge_index>>6] |= uint64_t(1) << (edge_index&63);}
+  inline bool EdgeUsed(uint32_t edge_index) const {return used_edges[edge_index>>6] >> (edge_index&63) & 1;}
+
+  //every bond is offered from both of its tiles, so a closure with one bond fewer than tiles has no cycles
+  //then each build uses every bond, and so the edge usage of a build is exactly used_edges
+  inline bool IsTree() const {return bond_offers==2*(placed_tiles.size()/3-1);}
 };
 
 //Core assembly class and genotype manipulation.
@@ -29,13 +447,39 @@ class PolyominoAssembly {
 public:
   //start assembly with random seed
   inline static bool free_seed=true; 
+
+  //models with fixed-width unsigned interfaces can opt in to the bulk SIMD kernel by defining in Q
+  //  static constexpr bool bitstring_interactions=true;
+  //  static T BindingKey(T)                    value a partner interface is compared against, e.g. its complement
+  //  static double MismatchStrength(uint8_t)   strength given popcount(a^BindingKey(b)), zero for no interaction
+  //so that InteractionMatrix(a,b)==MismatchStrength(popcount(a^BindingKey(b))), which must be symmetric in a and b
+  static constexpr bool bitstring_interactions=false;
   
   //produce a random genotype with no interactions
   template<typename T, typename A>
   static void RandomiseGenotype(std::vector<T,A>& genotype) {
     do {
-      std::generate(genotype.begin(),genotype.end(),Q::GenRandomSite);
-    }while(!Q::GetActiveInterfaces(genotype).empty());
+      std::generate(genotype.begin(),genotype.end(),[](){return Q::GenRandomSite();});
+    }while(Q::HasActiveInterfaces(genotype));
+  }
+
+  //check for any interaction, stopping at the first one rather than collecting all edges
+  template <typename T, typename A>
+  static bool HasActiveInterfaces(const std::vector<T,A>& genotype) {
+    if constexpr(Q::bitstring_interactions) {
+      thread_local std::vector<double> row_strengths;
+      for(size_t b1=0;b1<genotype.size();++b1) {
+        Q::InteractionRow(genotype,b1,b1,row_strengths);
+        if(std::any_of(row_strengths.begin(),row_strengths.end(),[](double B_ij){return B_ij!=0;}))
+          return true;
+      }
+      return false;
+    }
+    for(size_t b1=0;b1<genotype.size();++b1)
+      for(size_t b2=b1;b2<genotype.size();++b2) 
+        if(Q::InteractionMatrix(genotype[b1],genotype[b2]))
+          return true;
+    return false;
   }
   
   //strip all subunits which cannot interact with initial subunit
@@ -43,19 +487,31 @@ public:
   static std::vector<T,A> StripNoncodingGenotype(std::vector<T,A>& genotype) {
     std::vector<size_t> coding{0},noncoding(genotype.size()/4-1);
     std::iota(noncoding.begin(), noncoding.end(), 1);
+
+    //bitstring models evaluate each coding face against every interface in bulk
+    std::vector<double> row_strengths;
+    const auto interacts=[&genotype,&row_strengths](size_t coding_interface,size_t noncoding_interface) {
+      if constexpr(Q::bitstring_interactions)
+        return row_strengths[noncoding_interface]!=0;
+      else
+        return Q::InteractionMatrix(genotype[coding_interface],genotype[noncoding_interface])!=0;
+    };
   
     for(size_t c_in=0;c_in<coding.size();++c_in)
-      for(uint8_t cface=0;cface<4;++cface)
+      for(uint8_t cface=0;cface<4;++cface) {
+        if constexpr(Q::bitstring_interactions)
+          Q::InteractionRow(genotype,coding[c_in]*4+cface,0,row_strengths);
         for(size_t nc_in=0;nc_in<noncoding.size();++nc_in) {
           for(uint8_t ncface=0;ncface<4;++ncface)
 	    //if there is an interaction add tile to coding and loop back
-            if(Q::InteractionMatrix(genotype[coding[c_in]*4+cface],genotype[noncoding[nc_in]*4+ncface])){
+            if(interacts(coding[c_in]*4+cface,noncoding[nc_in]*4+ncface)){
               coding.emplace_back(noncoding[nc_in]);
               noncoding.erase(noncoding.begin()+nc_in--);
               goto newtile;
             }
         newtile: ;
         }
+      }
 
     //remove tiles that were not coding
     std::vector<T,A> removed;
@@ -72,74 +528,268 @@ public:
   template <typename T, typename A>
   static std::vector<std::pair<InteractionPair,double> > GetActiveInterfaces(const std::vector<T,A>& genotype) {
     std::vector<std::pair<InteractionPair,double> > edge_pairs;
+    GetActiveInterfaces(genotype,edge_pairs);
+    return edge_pairs;
+  }
+
+  //as above, into a reusable buffer
+  template <typename T, typename A>
+  static void GetActiveInterfaces(const std::vector<T,A>& genotype, std::vector<std::pair<InteractionPair,double> >& edge_pairs) {
+    edge_pairs.clear();
+
+    //bitstring models compute each row of mismatches at once against the precomputed binding keys
+    if constexpr(Q::bitstring_interactions) {
+      const auto strength_table=MismatchStrengths<T>();
+      thread_local std::vector<T> binding_keys;
+      thread_local std::vector<uint8_t> mismatches;
+      binding_keys.resize(genotype.size());
+      mismatches.resize(genotype.size());
+      std::transform(genotype.begin(),genotype.end(),binding_keys.begin(),[](const T& site){return Q::BindingKey(site);});
+      for(size_t b1=0;b1<genotype.size();++b1) {
+        MismatchCounts(binding_keys.data()+b1,genotype.size()-b1,genotype[b1],mismatches.data());
+        for(size_t b2=b1;b2<genotype.size();++b2)
+          if(double B_ij=strength_table[mismatches[b2-b1]])
+            edge_pairs.emplace_back(InteractionPair{b1,b2},B_ij);
+      }
+      return;
+    }
+    
     for(size_t b1=0;b1<genotype.size();++b1)
       for(size_t b2=b1;b2<genotype.size();++b2) 
         if(double B_ij=Q::InteractionMatrix(genotype[b1],genotype[b2]))
           edge_pairs.emplace_back(InteractionPair{b1,b2},B_ij);
-    
-    return edge_pairs;
+  }
+
+  //bulk hook for the strengths between one interface and the partners [first_partner,N), each pair evaluated as in GetActiveInterfaces
+  //models can shadow this with their own bulk evaluation, bitstring models use the SIMD mismatch kernel
+  template <typename T, typename A>
+  static void InteractionRow(const std::vector<T,A>& genotype, size_t site, size_t first_partner, std::vector<double>& strengths) {
+    strengths.resize(genotype.size()-first_partner);
+    if constexpr(Q::bitstring_interactions) {
+      const auto strength_table=MismatchStrengths<T>();
+      thread_local std::vector<T> binding_keys;
+      thread_local std::vector<uint8_t> mismatches;
+      mismatches.resize(strengths.size());
+
+      //partners before the site are compared against its binding key, later partners against their own keys
+      const size_t split=std::max(site,first_partner);
+      MismatchCounts(genotype.data()+first_partner,split-first_partner,Q::BindingKey(genotype[site]),mismatches.data());
+      binding_keys.resize(genotype.size()-split);
+      std::transform(genotype.begin()+split,genotype.end(),binding_keys.begin(),[](const T& partner){return Q::BindingKey(partner);});
+      MismatchCounts(binding_keys.data(),binding_keys.size(),genotype[site],mismatches.data()+(split-first_partner));
+      for(size_t partner=0;partner<strengths.size();++partner)
+        strengths[partner]=strength_table[mismatches[partner]];
+    }
+    else
+      for(size_t partner=first_partner;partner<genotype.size();++partner)
+        strengths[partner-first_partner]=Q::InteractionMatrix(genotype[std::min(site,partner)],genotype[std::max(site,partner)]);
+  }
+
+  //all interaction,strength tuples involving a single interface, ordered by the partner index
+  //argument order matches GetActiveInterfaces, so the strengths are identical to a full recompute
+  template <typename T, typename A>
+  static void GetInterfaceRow(const std::vector<T,A>& genotype, size_t site, std::vector<std::pair<InteractionPair,double> >& row_edges) {
+    thread_local std::vector<double> row_strengths;
+    Q::InteractionRow(genotype,site,0,row_strengths);
+    row_edges.clear();
+    for(size_t partner=0;partner<genotype.size();++partner)
+      if(double B_ij=row_strengths[partner])
+        row_edges.emplace_back(InteractionPair{std::min(site,partner),std::max(site,partner)},B_ij);
+  }
+
+  //strength for each possible mismatch count of a bitstring model
+  template <typename T>
+  static std::array<double,8*sizeof(T)+1> MismatchStrengths() {
+    std::array<double,8*sizeof(T)+1> strength_table;
+    for(uint8_t mismatch=0;mismatch<strength_table.size();++mismatch)
+      strength_table[mismatch]=Q::MismatchStrength(mismatch);
+    return strength_table;
   }
 
   //main assembly function, takes in edges of assembly graph
   static inline std::pair< std::vector<int8_t>, std::set<InteractionPair> > AssemblePolyomino(const std::vector<std::pair<InteractionPair,double> >& edges) {
-    std::set<InteractionPair> interacting_indices;
+    return AssemblePolyomino(InterfaceAdjacency(edges));
+  }
+
+  //assembly from pre-indexed edges, so repeated builds of a genotype can share the index
+  static inline std::pair< std::vector<int8_t>, std::set<InteractionPair> > AssemblePolyomino(const InterfaceAdjacency& adjacency) {
+    thread_local AssemblyContext shared_context;
+    if(!AssemblePolyomino(adjacency,shared_context))
+      return {};
+    return std::make_pair(shared_context.placed_tiles, shared_context.InteractingIndices(adjacency));
+  }
+
+  //assembly into reusable buffers, returning false if the assembly was unbound
+  static inline bool AssemblePolyomino(const InterfaceAdjacency& adjacency, AssemblyContext& context) {
+    return AssemblePolyomino(adjacency,context,RNG_Engine);
+  }
+
+  //assembly drawing from a given generator, such as a Philox4x32 stream for the build
+  template<typename URBG>
+  static inline bool AssemblePolyomino(const InterfaceAdjacency& adjacency, AssemblyContext& context, URBG& rng) {
+    context.Reset(adjacency);
+    std::vector<int8_t>& placed_tiles=context.placed_tiles;
+    POLYOMINO_METRIC_COUNT(Assemblies,1);
     
     //if no edges, it is trivially a momomer
-    if(edges.empty())
-      return std::make_pair(std::vector<int8_t>{0,0,1}, interacting_indices);
+    if(adjacency.empty()) {
+      placed_tiles.assign({0,0,1});
+      POLYOMINO_METRIC_RECORD(StepsPerAssembly,0);
+      return true;
+    }
 
     //determine max seeding by max subunit that has an edge
-    auto max_subunit = std::max_element(edges.begin(), edges.end(),[](const auto& left, const auto& right){return left.first.second <  right.first.second;})->first.second;
-    const int8_t seed = 1+Q::free_seed*4*std::uniform_int_distribution<uint8_t>(0,max_subunit/4)(RNG_Engine);
+    const size_t max_subunit = adjacency.max_interface;
+    const int8_t seed = 1+Q::free_seed*4*std::uniform_int_distribution<uint8_t>(0,max_subunit/4)(rng);
     
     //N tile polyomino theoretically bounded by size 4*N^2
     const size_t UNBOUND_LIMIT= 12*(max_subunit/4+1)*(max_subunit/4+1); 
 
     //initialise assembly and required information, extend initial perimeter
-    std::vector<int8_t> placed_tiles{0,0,seed},growing_perimeter;
-    std::vector<double> strengths_cdf;
-    PotentialTileSites perimeter_sites;
+    placed_tiles.assign({0,0,seed});
+    WeightedTileSites& perimeter_sites=context.perimeter_sites;
+    OccupancyGrid& occupied_sites=context.occupied_sites;
+    occupied_sites.Occupy(0,0);
     
-    
-    ExtendPerimeter(edges,seed,0,0,placed_tiles,perimeter_sites);
+    ExtendPerimeter(adjacency,seed,0,0,occupied_sites,perimeter_sites);
     
     //while there are potential sites on the perimeter, keep assembling
-    while(!perimeter_sites.strengths.empty()) {
+    while(!perimeter_sites.empty()) {
       
       //select new site proportional to binding strength 
-      strengths_cdf.resize(perimeter_sites.strengths.size());
-      std::partial_sum(perimeter_sites.strengths.begin(), perimeter_sites.strengths.end(), strengths_cdf.begin());
-      std::uniform_real_distribution<double> random_interval(0,strengths_cdf.back());
-      size_t selected_choice=static_cast<size_t>(std::lower_bound(strengths_cdf.begin(),strengths_cdf.end(),random_interval(RNG_Engine))-strengths_cdf.begin());
-      
-      auto chosen_site=perimeter_sites.sites[selected_choice];
+      POLYOMINO_METRIC_RECORD(PerimeterSize,perimeter_sites.size());
+      const size_t selected_choice=perimeter_sites.Sample(rng);
+      const auto chosen_site=perimeter_sites.sites[selected_choice].second;
 
       //place new tile 
-      placed_tiles.insert(placed_tiles.end(),chosen_site.second.begin(),chosen_site.second.end());
-      interacting_indices.insert(chosen_site.first);
-      if(placed_tiles.size()>UNBOUND_LIMIT)
-        return {};
+      placed_tiles.insert(placed_tiles.end(),chosen_site.begin(),chosen_site.end());
+      context.MarkEdge(perimeter_sites.edge_indices[selected_choice]);
+      POLYOMINO_METRIC_COUNT(AssemblySteps,1);
+      if(placed_tiles.size()>UNBOUND_LIMIT) {
+        POLYOMINO_METRIC_COUNT(UnboundAssemblies,1);
+        return false;
+      }
       
-      //remove all further options in same tile location
-      auto [f_x, f_y, f_t] = chosen_site.second;
-      for(size_t cut_index=0;cut_index<perimeter_sites.strengths.size();) {
-        if(f_x==perimeter_sites.sites[cut_index].second[0] && f_y==perimeter_sites.sites[cut_index].second[1]) {
-          perimeter_sites.strengths.erase(perimeter_sites.strengths.begin()+cut_index);
-          perimeter_sites.sites.erase(perimeter_sites.sites.begin()+cut_index);
-        }
-        else
-          ++cut_index;
+      //growth past the edge of the int8_t lattice cannot be represented, so also counts as unbound
+      auto [f_x, f_y, f_t] = chosen_site;
+      if(f_x==INT8_MIN || f_x==INT8_MAX || f_y==INT8_MIN || f_y==INT8_MAX) {
+        POLYOMINO_METRIC_COUNT(UnboundAssemblies,1);
+        return false;
       }
       
+      //remove all further options in same tile location
+      occupied_sites.Occupy(f_x,f_y);
+      perimeter_sites.RemoveLocation(f_x,f_y);
+      
       //add new possible edges on the new perimeter
-      ExtendPerimeter(edges,f_t,f_x,f_y,placed_tiles,perimeter_sites);
+      ExtendPerimeter(adjacency,f_t,f_x,f_y,occupied_sites,perimeter_sites);
     }
-    return std::make_pair(placed_tiles, interacting_indices);
+    POLYOMINO_METRIC_RECORD(StepsPerAssembly,placed_tiles.size()/3-1);
+    return true;
   }
- 
+
+  //static analysis of assembly from a seed tile, growing every offer at once instead of sampling one order
+  //if no site is offered two different tiles, every build places the same tiles whatever order they bind in, so this closure is the assembly
+  //binding is symmetric, so a tile repeated in a competition-free closure means the closure is invariant under a translation,
+  //and such cycles grow out to the unbound limit deterministically; only tiles a build could place before that limit are explored
+  //gives up as Unknown on any competing offer, or on exploring more than 4 times the unbound limit of tiles
+  static inline ClosureOutcome AssemblyClosure(const InterfaceAdjacency& adjacency, uint8_t seed, ClosureContext& context) {
+    context.Reset(adjacency);
+    std::vector<int8_t>& placed_tiles=context.placed_tiles;
+
+    if(adjacency.empty()) {
+      placed_tiles.assign({0,0,1});
+      context.distances.assign(1,0);
+      return ClosureOutcome::Bounded;
+    }
+
+    //same bound as AssemblePolyomino, counted in tiles rather than placed_tiles entries
+    const size_t max_subunit = adjacency.max_interface;
+    const size_t UNBOUND_TILES=4*(max_subunit/4+1)*(max_subunit/4+1);
+
+    placed_tiles.assign({0,0,static_cast<int8_t>(seed)});
+    context.distances.assign(1,0);
+    context.site_details[OccupancyGrid::SiteIndex(0,0)]=seed;
+    bool unbound=false;
+
+    //breadth first, so every tile within a given number of bonds of the seed is explored before any further one
+    for(size_t tile_index=0;tile_index<context.distances.size();++tile_index) {
+      const int8_t x=placed_tiles[3*tile_index],y=placed_tiles[3*tile_index+1];
+      const uint8_t tile_detail=static_cast<uint8_t>(placed_tiles[3*tile_index+2]);
+      const uint32_t distance=context.distances[tile_index];
+
+      //builds stop on placing a tile at the lattice edge, or can only reach tiles beyond this distance after passing the limit
+      if((tile_index && (x==INT8_MIN || x==INT8_MAX || y==INT8_MIN || y==INT8_MAX)) || distance==UNBOUND_TILES) {
+        unbound=true;
+        continue;
+      }
+
+      context.offers.clear();
+      ExtendPerimeterIf(adjacency,tile_detail,x,y,[](int,int) {return false;},context);
+      for(const auto& [site,edge_index] : context.offers) {
+        uint8_t& site_detail=context.site_details[OccupancyGrid::SiteIndex(site[0],site[1])];
+        if(site_detail==0) {
+          site_detail=static_cast<uint8_t>(site[2]);
+          placed_tiles.insert(placed_tiles.end(),site.begin(),site.end());
+          context.distances.emplace_back(distance+1);
+          context.MarkEdge(edge_index);
+          ++context.bond_offers;
+          if(context.distances.size()>4*UNBOUND_TILES)
+            return ClosureOutcome::Unknown;
+        }
+        else if(site_detail==static_cast<uint8_t>(site[2]))
+          ++context.bond_offers;
+        //the seed site is filled before any offer is made, so offers to it never compete
+        else if(site[0]!=0 || site[1]!=0)
+          return ClosureOutcome::Unknown;
+      }
+    }
+    return unbound || context.distances.size()>UNBOUND_TILES ? ClosureOutcome::Unbound : ClosureOutcome::Bounded;
+  }
+
+  //extend the perimeter, checking occupancy by scanning the placed tiles
+  //kept for callers holding only the edge list, which is scanned linearly rather than indexed on every call
   static inline void ExtendPerimeter(const std::vector<std::pair<InteractionPair,double> >& edges,uint8_t tile_detail, int8_t x,int8_t y, std::vector<int8_t>& placed_tiles,PotentialTileSites& perimeter_sites) {
     int8_t dx=0,dy=0,tile=(tile_detail-1)/4,theta=(tile_detail-1)%4;
 
+    //loop over the 4 possible faces
+    for(uint8_t f=0;f<4;++f) {
+      switch(f) {
+      case 0:dx=0;dy=1;break;
+      case 1:dx=1;dy=0;break;
+      case 2:dx=0;dy=-1;break;
+      case 3:dx=-1;dy=0;break;
+      }
+
+      //site already occupied, move on
+      const int site_x=x+dx, site_y=y+dy;
+      bool occupied=false;
+      for(size_t tile_info=0;tile_info<placed_tiles.size() && !occupied;tile_info+=3)
+        occupied=site_x==placed_tiles[tile_info] && site_y==placed_tiles[tile_info+1];
+      if(occupied)
+        continue;
+
+      //find all edges that connect to this tile at this face, and add location and strengths to information
+      const uint8_t g_index=static_cast<uint8_t>(tile*4+(f-theta+4)%4);
+      for(auto iter=edges.begin();(iter=std::find_if(iter,edges.end(),[g_index](const auto& edge){return edge.first.first==g_index || edge.first.second==g_index;}))!=edges.end();++iter) {
+        int8_t base = static_cast<int8_t>(iter->first.first==g_index ? iter->first.second : iter->first.first);
+        perimeter_sites.Add(iter->first,std::array<int8_t,3>{static_cast<int8_t>(site_x),static_cast<int8_t>(site_y),static_cast<int8_t>(base-base%4+((f+2)%4-base%4+4)%4+1)},iter->second);
+      }
+    }
+  }
+
+  //extend the perimeter, checking occupancy against the grid in constant time
+  template<typename TileSites>
+  static inline void ExtendPerimeter(const InterfaceAdjacency& adjacency,uint8_t tile_detail, int8_t x,int8_t y, const OccupancyGrid& occupied_sites,TileSites& perimeter_sites) {
+    ExtendPerimeterIf(adjacency,tile_detail,x,y,[&occupied_sites](int site_x,int site_y) {
+        return occupied_sites.IsOccupied(static_cast<int8_t>(site_x),static_cast<int8_t>(site_y));},perimeter_sites);
+  }
+
+  //add options on each unoccupied face of a tile, where is_occupied reports if a neighbouring site is filled
+  template<typename OccupancyCheck, typename TileSites>
+  static inline void ExtendPerimeterIf(const InterfaceAdjacency& adjacency,uint8_t tile_detail, int8_t x,int8_t y, OccupancyCheck&& is_occupied,TileSites& perimeter_sites) {
+    int8_t dx=0,dy=0,tile=(tile_detail-1)/4,theta=(tile_detail-1)%4;
+
     //loop over the 4 possible faces
     for(uint8_t f=0;f<4;++f) {
       switch(f) {
@@ -150,27 +800,51 @@ public:
       }
       
       //site already occupied, move on 
-      for(std::vector<int8_t>::reverse_iterator tile_info=placed_tiles.rbegin();tile_info!=placed_tiles.rend();tile_info+=3) 
-        if((x+dx)==*(tile_info+2) && (y+dy)==*(tile_info+1)) 
-          goto nextloop;
-
-      //empty scope to prevent cross-initilisation errors from goto
-      {
-        uint8_t g_index=static_cast<uint8_t>(tile*4+(f-theta+4)%4);
-        std::vector<std::pair<InteractionPair,double> >::const_iterator iter = edges.begin();
-	
-	//find all edges that connect to this tile at this face, and add location and strengths to information
-        while ((iter = std::find_if(iter, edges.end(),[&g_index](const auto& edge){ return (edge.first.first == g_index || edge.first.second == g_index);})) != edges.end()) {
-          int8_t base = iter->first.first==g_index ? iter->first.second : iter->first.first;
-          perimeter_sites.sites.emplace_back(iter->first,std::array<int8_t,3>{static_cast<int8_t>(x+dx),static_cast<int8_t>(y+dy),static_cast<int8_t>(base-base%4+((f+2)%4-base%4+4)%4+1)});
-          perimeter_sites.strengths.emplace_back(iter->second);
-          ++iter;
-        }
+      if(is_occupied(x+dx,y+dy))
+        continue;
+
+      //add location and strengths for all edges that connect to this tile at this face
+      const uint8_t g_index=static_cast<uint8_t>(tile*4+(f-theta+4)%4);
+      const auto [first_partner,last_partner]=adjacency.PartnersOf(g_index);
+      for(auto partner=first_partner;partner!=last_partner;++partner) {
+        int8_t base = static_cast<int8_t>(partner->partner_interface);
+        perimeter_sites.Add(partner->edge,std::array<int8_t,3>{static_cast<int8_t>(x+dx),static_cast<int8_t>(y+dy),static_cast<int8_t>(base-base%4+((f+2)%4-base%4+4)%4+1)},partner->strength,partner->edge_index);
       }
-      
-      //continue if site already occupied
-    nextloop: ; 
     }   
   }
   
 };
+
+//edge set of a genotype kept up to date under point mutations, by re-evaluating only the mutated interface's row
+//edges stay in the same order as GetActiveInterfaces, which remains available through Validate
+template<class Q>
+class IncrementalInterfaces {
+public:
+  IncrementalInterfaces(void) {}
+  template<typename T, typename A>
+  explicit IncrementalInterfaces(const std::vector<T,A>& genotype) : edges(Q::GetActiveInterfaces(genotype)) {}
+
+  const std::vector<std::pair<InteractionPair,double> >& Edges() const {return edges;}
+
+  //full recompute for a new genotype
+  template<typename T, typename A>
+  void Reset(const std::vector<T,A>& genotype) {edges=Q::GetActiveInterfaces(genotype);}
+
+  //refresh edges after genotype[site] has changed, O(N) interaction evaluations plus a linear merge
+  template<typename T, typename A>
+  void UpdateSite(const std::vector<T,A>& genotype, size_t site) {
+    edges.erase(std::remove_if(edges.begin(),edges.end(),[site](const auto& edge){return edge.first.first==site || edge.first.second==site;}),edges.end());
+    Q::GetInterfaceRow(genotype,site,row_edges);
+
+    const size_t retained_edges=edges.size();
+    edges.insert(edges.end(),row_edges.begin(),row_edges.end());
+    std::inplace_merge(edges.begin(),edges.begin()+retained_edges,edges.end(),[](const auto& left,const auto& right){return left.first<right.first;});
+  }
+
+  //compare against a full recompute
+  template<typename T, typename A>
+  bool Validate(const std::vector<T,A>& genotype) const {return edges==Q::GetActiveInterfaces(genotype);}
+
+private:
+  std::vector<std::pair<InteractionPair,double> > edges, row_edges;
+};
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#endif
+
+//mismatch counts popcount(values[i]^probe) for fixed-width unsigned interfaces, the core of bitstring interaction models
+//uses AVX2 or SSSE3 nibble lookups when compiled for them (e.g. -mavx2 or -march=native), with a scalar fallback for the remainder
+template<typename T>
+inline void MismatchCounts(const T* values, size_t count, T probe, uint8_t* mismatches) {
+  static_assert(std::is_unsigned<T>::value && (sizeof(T)==1 || sizeof(T)==2 || sizeof(T)==4 || sizeof(T)==8),"mismatch kernel needs 8, 16, 32 or 64 bit unsigned interfaces");
+  size_t index=0;
+
+#if defined(__AVX2__)
+  constexpr size_t LANES=32/sizeof(T);
+  T probe_lanes[LANES];
+  for(T& lane : probe_lanes)
+    lane=probe;
+  const __m256i probe_vector=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(probe_lanes));
+  const __m256i nibble_counts=_mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+  const __m256i low_nibbles=_mm256_set1_epi8(0x0f);
+
+  for(;index+LANES<=count;index+=LANES) {
+    const __m256i differing=_mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(values+index)),probe_vector);
+    const __m256i byte_counts=_mm256_add_epi8(_mm256_shuffle_epi8(nibble_counts,_mm256_and_si256(differing,low_nibbles)),
+                                              _mm256_shuffle_epi8(nibble_counts,_mm256_and_si256(_mm256_srli_epi16(differing,4),low_nibbles)));
+    //widen byte counts to the interface width, then narrow back to one byte per interface
+    if constexpr(sizeof(T)==1) {
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(mismatches+index),byte_counts);
+    }
+    else {
+      alignas(32) T lane_counts[LANES];
+      __m256i widened;
+      if constexpr(sizeof(T)==2)
+        widened=_mm256_maddubs_epi16(byte_counts,_mm256_set1_epi8(1));
+      else if constexpr(sizeof(T)==4)
+        widened=_mm256_madd_epi16(_mm256_maddubs_epi16(byte_counts,_mm256_set1_epi8(1)),_mm256_set1_epi16(1));
+      else
+        widened=_mm256_sad_epu8(byte_counts,_mm256_setzero_si256());
+      _mm256_store_si256(reinterpret_cast<__m256i*>(lane_counts),widened);
+      for(size_t lane=0;lane<LANES;++lane)
+        mismatches[index+lane]=static_cast<uint8_t>(lane_counts[lane]);
+    }
+  }
+#elif defined(__SSSE3__)
+  constexpr size_t LANES=16/sizeof(T);
+  T probe_lanes[LANES];
+  for(T& lane : probe_lanes)
+    lane=probe;
+  const __m128i probe_vector=_mm_loadu_si128(reinterpret_cast<const __m128i*>(probe_lanes));
+  const __m128i nibble_counts=_mm_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+  const __m128i low_nibbles=_mm_set1_epi8(0x0f);
+
+  for(;index+LANES<=count;index+=LANES) {
+    const __m128i differing=_mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values+index)),probe_vector);
+    const __m128i byte_counts=_mm_add_epi8(_mm_shuffle_epi8(nibble_counts,_mm_and_si128(differing,low_nibbles)),
+                                           _mm_shuffle_epi8(nibble_counts,_mm_and_si128(_mm_srli_epi16(differing,4),low_nibbles)));
+    if constexpr(sizeof(T)==1) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(mismatches+index),byte_counts);
+    }
+    else {
+      alignas(16) T lane_counts[LANES];
+      __m128i widened;
+      if constexpr(sizeof(T)==2)
+        widened=_mm_maddubs_epi16(byte_counts,_mm_set1_epi8(1));
+      else if constexpr(sizeof(T)==4)
+        widened=_mm_madd_epi16(_mm_maddubs_epi16(byte_counts,_mm_set1_epi8(1)),_mm_set1_epi16(1));
+      else
+        widened=_mm_sad_epu8(byte_counts,_mm_setzero_si128());
+      _mm_store_si128(reinterpret_cast<__m128i*>(lane_counts),widened);
+      for(size_t lane=0;lane<LANES;++lane)
+        mismatches[index+lane]=static_cast<uint8_t>(lane_counts[lane]);
+    }
+  }
+#endif
+
+  for(;index<count;++index)
+    mismatches[index]=static_cast<uint8_t>(__builtin_popcountll(static_cast<uint64_t>(values[index]^probe)));
+}
@@ -0,0 +1,243 @@
+#pragma once
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+//hot-path instrumentation, compiled in with -DPOLYOMINO_METRICS=1
+//when disabled the recording macros expand to nothing, so instrumented code is the same as uninstrumented code
+#ifndef POLYOMINO_METRICS
+#define POLYOMINO_METRICS 0
+#endif
+
+//running totals
+enum class MetricCounter : uint8_t {Assemblies,AssemblySteps,UnboundAssemblies,PhenotypeLookups,PhenotypePromotions,Selections,COUNT};
+//distributions, in power of two buckets
+enum class MetricHistogram : uint8_t {PerimeterSize,StepsPerAssembly,PhenotypeProbeDepth,SelectionNanoseconds,COUNT};
+
+constexpr size_t METRIC_COUNTERS=static_cast<size_t>(MetricCounter::COUNT), METRIC_HISTOGRAMS=static_cast<size_t>(MetricHistogram::COUNT);
+constexpr std::array<const char*,METRIC_COUNTERS> METRIC_COUNTER_NAMES{"assemblies","assembly_steps","unbound_assemblies","phenotype_lookups","phenotype_promotions","selections"};
+constexpr std::array<const char*,METRIC_HISTOGRAMS> METRIC_HISTOGRAM_NAMES{"perimeter_size","steps_per_assembly","phenotype_probe_depth","selection_nanoseconds"};
+
+//bucket 0 holds zeros, and bucket b holds values in [2^(b-1),2^b)
+constexpr size_t HISTOGRAM_BUCKETS=65;
+
+inline size_t HistogramBucket(uint64_t value) {
+  return value ? 64-__builtin_clzll(value) : 0;
+}
+
+//merged copy of the metrics, which can be combined and exported
+struct MetricsSnapshot {
+  struct Histogram {
+    uint64_t count=0, sum=0, max=0;
+    std::array<uint64_t,HISTOGRAM_BUCKETS> buckets{};
+
+    inline double Mean() const {return count ? static_cast<double>(sum)/count : 0;}
+
+    //upper edge of the bucket holding the given quantile, accurate to a factor of two
+    inline uint64_t Quantile(double quantile) const {
+      uint64_t seen=0;
+      for(size_t bucket=0;bucket<HISTOGRAM_BUCKETS;++bucket)
+        if((seen+=buckets[bucket])>0 && seen>=quantile*count)
+          return bucket ? std::min(max,bucket<64 ? (uint64_t(1)<<bucket)-1 : UINT64_MAX) : 0;
+      return max;
+    }
+  };
+
+  std::array<uint64_t,METRIC_COUNTERS> counters{};
+  std::array<Histogram,METRIC_HISTOGRAMS> histograms{};
+
+  inline uint64_t operator[](MetricCounter counter) const {return counters[static_cast<size_t>(counter)];}
+  inline const Histogram& operator[](MetricHistogram histogram) const {return histograms[static_cast<size_t>(histogram)];}
+
+  inline void Merge(const MetricsSnapshot& other) {
+    for(size_t counter=0;counter<METRIC_COUNTERS;++counter)
+      counters[counter]+=other.counters[counter];
+    for(size_t histogram=0;histogram<METRIC_HISTOGRAMS;++histogram) {
+      Histogram& merged=histograms[histogram];
+      const Histogram& added=other.histograms[histogram];
+      merged.count+=added.count;
+      merged.sum+=added.sum;
+      merged.max=std::max(merged.max,added.max);
+      for(size_t bucket=0;bucket<HISTOGRAM_BUCKETS;++bucket)
+        merged.buckets[bucket]+=added.buckets[bucket];
+    }
+  }
+
+  //single object, with histogram buckets trimmed after the last nonempty one
+  inline void WriteJSON(std::ostream& out) const {
+    out<<"{\"counters\":{";
+    for(size_t counter=0;counter<METRIC_COUNTERS;++counter)
+      out<<(counter ? "," : "")<<'"'<<METRIC_COUNTER_NAMES[counter]<<"\":"<<counters[counter];
+    out<<"},\"histograms\":{";
+    for(size_t histogram=0;histogram<METRIC_HISTOGRAMS;++histogram) {
+      const Histogram& values=histograms[histogram];
+      out<<(histogram ? "," : "")<<'"'<<METRIC_HISTOGRAM_NAMES[histogram]<<"\":{\"count\":"<<values.count<<",\"sum\":"<<values.sum<<",\"max\":"<<values.max<<",\"buckets\":[";
+      for(size_t bucket=0;bucket<UsedBuckets(values);++bucket)
+        out<<(bucket ? "," : "")<<values.buckets[bucket];
+      out<<"]}";
+    }
+    out<<"}}\n";
+  }
+
+  //long format, "kind,name,bucket,value" rows, where bucket b counts values below 2^b (and is empty for totals)
+  inline void WriteCSV(std::ostream& out) const {
+    out<<"kind,name,bucket,value\n";
+    for(size_t counter=0;counter<METRIC_COUNTERS;++counter)
+      out<<"counter,"<<METRIC_COUNTER_NAMES[counter]<<",,"<<counters[counter]<<"\n";
+    for(size_t histogram=0;histogram<METRIC_HISTOGRAMS;++histogram) {
+      const Histogram& values=histograms[histogram];
+      const char* name=METRIC_HISTOGRAM_NAMES[histogram];
+      out<<"count,"<<name<<",,"<<values.count<<"\nsum,"<<name<<",,"<<values.sum<<"\nmax,"<<name<<",,"<<values.max<<"\n";
+      for(size_t bucket=0;bucket<UsedBuckets(values);++bucket)
+        out<<"bucket,"<<name<<","<<bucket<<","<<values.buckets[bucket]<<"\n";
+    }
+  }
+
+private:
+  static inline size_t UsedBuckets(const Histogram& values) {
+    size_t used=HISTOGRAM_BUCKETS;
+    while(used && !values.buckets[used-1])
+      --used;
+    return used;
+  }
+};
+
+//metrics written by a single thread, read by any
+//the owner updates with relaxed loads and stores rather than atomic increments, so recording costs the same as a plain counter
+class MetricsShard {
+public:
+  MetricsShard();
+  ~MetricsShard();
+
+  inline void Count(MetricCounter counter,uint64_t amount=1) {
+    Add(counters[static_cast<size_t>(counter)],amount);
+  }
+
+  inline void Record(MetricHistogram histogram,uint64_t value) {
+    Histogram& values=histograms[static_cast<size_t>(histogram)];
+    Add(values.count,1);
+    Add(values.sum,value);
+    if(value>values.max.load(std::memory_order_relaxed))
+      values.max.store(value,std::memory_order_relaxed);
+    Add(values.buckets[HistogramBucket(value)],1);
+  }
+
+  inline void AddTo(MetricsSnapshot& snapshot) const {
+    MetricsSnapshot shard_snapshot;
+    for(size_t counter=0;counter<METRIC_COUNTERS;++counter)
+      shard_snapshot.counters[counter]=counters[counter].load(std::memory_order_relaxed);
+    for(size_t histogram=0;histogram<METRIC_HISTOGRAMS;++histogram) {
+      const Histogram& values=histograms[histogram];
+      MetricsSnapshot::Histogram& copied=shard_snapshot.histograms[histogram];
+      copied.count=values.count.load(std::memory_order_relaxed);
+      copied.sum=values.sum.load(std::memory_order_relaxed);
+      copied.max=values.max.load(std::memory_order_relaxed);
+      for(size_t bucket=0;bucket<HISTOGRAM_BUCKETS;++bucket)
+        copied.buckets[bucket]=values.buckets[bucket].load(std::memory_order_relaxed);
+    }
+    snapshot.Merge(shard_snapshot);
+  }
+
+  inline void Clear() {
+    for(auto& counter : counters)
+      counter.store(0,std::memory_order_relaxed);
+    for(Histogram& values : histograms) {
+      values.count.store(0,std::memory_order_relaxed);
+      values.sum.store(0,std::memory_order_relaxed);
+      values.max.store(0,std::memory_order_relaxed);
+      for(auto& bucket : values.buckets)
+        bucket.store(0,std::memory_order_relaxed);
+    }
+  }
+
+private:
+  struct Histogram {
+    std::atomic<uint64_t> count{0}, sum{0}, max{0};
+    std::array<std::atomic<uint64_t>,HISTOGRAM_BUCKETS> buckets{};
+  };
+
+  static inline void Add(std::atomic<uint64_t>& total,uint64_t amount) {
+    total.store(total.load(std::memory_order_relaxed)+amount,std::memory_order_relaxed);
+  }
+
+  std::array<std::atomic<uint64_t>,METRIC_COUNTERS> counters{};
+  std::array<Histogram,METRIC_HISTOGRAMS> histograms{};
+};
+
+//every live shard, plus the totals of shards whose threads have exited
+class MetricsRegistry {
+public:
+  static inline MetricsRegistry& Instance() {
+    static MetricsRegistry registry;
+    return registry;
+  }
+
+  inline void Register(MetricsShard* shard) {
+    std::lock_guard<std::mutex> registry_lock(registry_mutex);
+    shards.emplace_back(shard);
+  }
+
+  inline void Retire(MetricsShard* shard) {
+    std::lock_guard<std::mutex> registry_lock(registry_mutex);
+    shard->AddTo(retired);
+    shards.erase(std::find(shards.begin(),shards.end(),shard));
+  }
+
+  inline MetricsSnapshot Collect() {
+    std::lock_guard<std::mutex> registry_lock(registry_mutex);
+    MetricsSnapshot snapshot=retired;
+    for(const MetricsShard* shard : shards)
+      shard->AddTo(snapshot);
+    return snapshot;
+  }
+
+  //only exact while no thread is recording, e.g. between generations
+  inline void Reset() {
+    std::lock_guard<std::mutex> registry_lock(registry_mutex);
+    retired=MetricsSnapshot{};
+    for(MetricsShard* shard : shards)
+      shard->Clear();
+  }
+
+private:
+  std::mutex registry_mutex;
+  std::vector<MetricsShard*> shards;
+  MetricsSnapshot retired;
+};
+
+inline MetricsShard::MetricsShard() {MetricsRegistry::Instance().Register(this);}
+inline MetricsShard::~MetricsShard() {MetricsRegistry::Instance().Retire(this);}
+
+inline MetricsShard& LocalMetrics() {
+  thread_local MetricsShard shard;
+  return shard;
+}
+
+//metrics merged over all threads so far, which are all zero if compiled without POLYOMINO_METRICS
+inline MetricsSnapshot CollectMetrics() {return MetricsRegistry::Instance().Collect();}
+inline void ResetMetrics() {MetricsRegistry::Instance().Reset();}
+
+//records the lifetime of the enclosing scope in nanoseconds
+class MetricsTimer {
+public:
+  explicit MetricsTimer(MetricHistogram timed_histogram) : histogram(timed_histogram), start(std::chrono::steady_clock::now()) {}
+  ~MetricsTimer() {LocalMetrics().Record(histogram,std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-start).count());}
+private:
+  MetricHistogram histogram;
+  std::chrono::steady_clock::time_point start;
+};
+
+#if POLYOMINO_METRICS
+#define POLYOMINO_METRIC_COUNT(counter,amount) LocalMetrics().Count(MetricCounter::counter,amount)
+#define POLYOMINO_METRIC_RECORD(histogram,value) LocalMetrics().Record(MetricHistogram::histogram,value)
+#define POLYOMINO_METRIC_TIMER(histogram) MetricsTimer metrics_timer(MetricHistogram::histogram)
+#else
+#define POLYOMINO_METRIC_COUNT(counter,amount) ((void)0)
+#define POLYOMINO_METRIC_RECORD(histogram,value) ((void)0)
+#define POLYOMINO_METRIC_TIMER(histogram) ((void)0)
+#endif
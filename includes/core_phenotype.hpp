@@ -1,5 +1,7 @@
 #pragma once
+#include <cassert>
 #include <cstdint>
+#include <cmath>
 #include <fstream>
 #include <iostream>
 
@@ -10,6 +12,14 @@
 #include <iterator>
 #include <sstream>
 #include <string>
+#include <array>
+#include <mutex>
+#include <shared_mutex>
+#include <memory>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include "core_metrics.hpp"
 
 //phenotype ID (pid) pair, storing phenotype size and index within that per-size vector
 using Phenotype_ID = std::pair<uint8_t,uint16_t>;
@@ -24,11 +34,116 @@ inline std::ostream & operator<<(std::ostream& os,Phenotype_ID& pid) {
 constexpr Phenotype_ID NULL_pid{0,0}, UNBOUND_pid{255,0};
 
 
+//byte vector for phenotype tilings, stored inline up to a fixed capacity and spilling to the heap for large extents
+//keeps the parts of the std::vector interface used on tilings, and converts to and from std::vector<uint8_t>
+class InlineTiling {
+public:
+  static constexpr uint32_t INLINE_CAPACITY=56;
+  
+  using value_type=uint8_t;
+  using size_type=size_t;
+  using iterator=uint8_t*;
+  using const_iterator=const uint8_t*;
+
+  InlineTiling(void) {}
+  InlineTiling(size_t count,uint8_t value=0) {assign(count,value);}
+  InlineTiling(std::initializer_list<uint8_t> values) {assign(values.begin(),values.end());}
+  template<typename InputIt, typename=typename std::iterator_traits<InputIt>::iterator_category>
+  InlineTiling(InputIt first,InputIt last) {assign(first,last);}
+  InlineTiling(const std::vector<uint8_t>& values) {assign(values.begin(),values.end());}
+  InlineTiling(const InlineTiling& other) {assign(other.begin(),other.end());}
+  InlineTiling(InlineTiling&& other) noexcept {*this=std::move(other);}
+
+  InlineTiling& operator=(const InlineTiling& other) {
+    if(this!=&other)
+      assign(other.begin(),other.end());
+    return *this;
+  }
+  InlineTiling& operator=(InlineTiling&& other) noexcept {
+    if(this==&other)
+      return *this;
+    if(other.heap_storage) {
+      heap_storage=std::move(other.heap_storage);
+      heap_capacity=other.heap_capacity;
+    }
+    else {
+      heap_storage.reset();
+      heap_capacity=0;
+      std::memcpy(inline_storage.data(),other.inline_storage.data(),other.length);
+    }
+    length=other.length;
+    other.length=0;
+    other.heap_capacity=0;
+    return *this;
+  }
+  InlineTiling& operator=(const std::vector<uint8_t>& values) {
+    assign(values.begin(),values.end());
+    return *this;
+  }
+  operator std::vector<uint8_t>() const {return std::vector<uint8_t>(begin(),end());}
+
+  inline uint8_t* data() {return heap_storage ? heap_storage.get() : inline_storage.data();}
+  inline const uint8_t* data() const {return heap_storage ? heap_storage.get() : inline_storage.data();}
+  inline size_t size() const {return length;}
+  inline bool empty() const {return length==0;}
+  inline size_t capacity() const {return heap_storage ? heap_capacity : INLINE_CAPACITY;}
+
+  inline iterator begin() {return data();}
+  inline iterator end() {return data()+length;}
+  inline const_iterator begin() const {return data();}
+  inline const_iterator end() const {return data()+length;}
+  inline uint8_t& operator[](size_t index) {return data()[index];}
+  inline const uint8_t& operator[](size_t index) const {return data()[index];}
+  inline uint8_t& back() {return data()[length-1];}
+
+  inline void reserve(size_t new_capacity) {
+    if(new_capacity<=capacity())
+      return;
+    std::unique_ptr<uint8_t[]> grown(new uint8_t[new_capacity]);
+    std::memcpy(grown.get(),data(),length);
+    heap_storage=std::move(grown);
+    heap_capacity=static_cast<uint32_t>(new_capacity);
+  }
+  inline void resize(size_t count,uint8_t value=0) {
+    reserve(count);
+    if(count>length)
+      std::memset(data()+length,value,count-length);
+    length=static_cast<uint32_t>(count);
+  }
+  inline void assign(size_t count,uint8_t value) {
+    length=0;
+    resize(count,value);
+  }
+  template<typename InputIt, typename=typename std::iterator_traits<InputIt>::iterator_category>
+  inline void assign(InputIt first,InputIt last) {
+    length=0;
+    reserve(std::distance(first,last));
+    for(uint8_t* write=data();first!=last;++first)
+      write[length++]=static_cast<uint8_t>(*first);
+  }
+  inline void clear() {length=0;}
+  inline void push_back(uint8_t value) {
+    if(length==capacity())
+      reserve(2*capacity());
+    data()[length++]=value;
+  }
+  inline void emplace_back(uint8_t value) {push_back(value);}
+
+  friend inline bool operator==(const InlineTiling& lhs,const InlineTiling& rhs) {return lhs.length==rhs.length && std::memcmp(lhs.data(),rhs.data(),lhs.length)==0;}
+  friend inline bool operator!=(const InlineTiling& lhs,const InlineTiling& rhs) {return !(lhs==rhs);}
+  friend inline bool operator<(const InlineTiling& lhs,const InlineTiling& rhs) {return std::lexicographical_compare(lhs.begin(),lhs.end(),rhs.begin(),rhs.end());}
+
+private:
+  std::array<uint8_t,INLINE_CAPACITY> inline_storage;
+  std::unique_ptr<uint8_t[]> heap_storage;
+  uint32_t length=0, heap_capacity=0;
+};
+
 struct Phenotype {
   
   //instance variables
   uint8_t dx,dy;
-  std::vector<uint8_t> tiling;
+  InlineTiling tiling;
   
   //static variables
   inline static bool FREE_POLYOMINO=true;
@@ -37,9 +152,10 @@ struct Phenotype {
   //constructors
   Phenotype(void) : dx{1}, dy{1}, tiling{1} {}
   Phenotype(uint8_t tdx, uint8_t tdy, const std::vector<uint8_t>& ttiling) : dx{tdx}, dy{tdy}, tiling{ttiling} {}
+  Phenotype(uint8_t tdx, uint8_t tdy, const InlineTiling& ttiling) : dx{tdx}, dy{tdy}, tiling{ttiling} {}
   
   //utility methods
-  bool operator==(const Phenotype& rhs) {return this->dx==rhs.dx && this->dy==rhs.dy && this->tiling==rhs.tiling;}
+  bool operator==(const Phenotype& rhs) const {return this->dx==rhs.dx && this->dy==rhs.dy && this->tiling==rhs.tiling;}
   inline friend std::ostream& operator<<(std::ostream& out, Phenotype& phen);
     
 };
@@ -55,6 +171,23 @@ inline std::ostream & operator<<(std::ostream& os,Phenotype& phen) {
   return os;
 }
 
+//hash of the (dx,dy,tiling) representation, using FNV-1a so the value is stable across runs and platforms
+inline uint64_t PhenotypeHash(const Phenotype& phen) {
+  uint64_t hash_value=14695981039346656037ULL;
+  const auto mix=[&hash_value](uint8_t byte) {hash_value=(hash_value^byte)*1099511628211ULL;};
+  mix(phen.dx);
+  mix(phen.dy);
+  for(uint8_t tile : phen.tiling)
+    mix(tile);
+  return hash_value;
+}
+
+namespace std {
+  template<> struct hash<Phenotype> {
+    size_t operator()(const Phenotype& phen) const noexcept {return static_cast<size_t>(PhenotypeHash(phen));}
+  };
+}
+
 //rotates polyomino pi/2 clockwise
 inline void ClockwiseRotation(Phenotype& phen) {
   std::vector<uint8_t> swapper;
@@ -83,7 +216,8 @@ inline void ChiralFlip(Phenotype& phen) {
 }
 
 //relabel the polyomino representation to be minimal
-inline void MinimizePhenRep(std::vector<uint8_t>& tiling) {
+template<typename Tiling>
+inline void MinimizePhenRep(Tiling& tiling) {
 
   //if single tile or only shape-dependent, relabel all as 1s
   if(tiling.size() == 1 || Phenotype::DETERMINISM_LEVEL == 1) {
@@ -98,7 +232,7 @@ inline void MinimizePhenRep(std::vector<uint8_t>& tiling) {
 
   //relabel tiles to new minimum swap value using 255 as an intermediate
   uint8_t swap_count=1;  
-  for(std::vector<uint8_t>::iterator t_iter=std::find_if(tiling.begin(),tiling.end(),[](const int s) { return s>0; });t_iter!=tiling.end();) {
+  for(auto t_iter=std::find_if(tiling.begin(),tiling.end(),[](const int s) { return s>0; });t_iter!=tiling.end();) {
     const uint8_t static_swap=*t_iter;
     for(uint8_t cyclic = 0; cyclic< (Phenotype::DETERMINISM_LEVEL==3?4:1); ++cyclic) {
       const uint8_t pre_swap=Phenotype::DETERMINISM_LEVEL==3 ? (static_swap-(static_swap-1)%4)+((static_swap-1)%4+cyclic)%4 : static_swap;
@@ -112,90 +246,350 @@ inline void MinimizePhenRep(std::vector<uint8_t>& tiling) {
 }
 
 //find minimum relabelling over all rotations and chiral flips
-inline void GetMinPhenRepresentation(Phenotype& phen) {
-  std::vector< std::vector<uint8_t> > min_tilings;
-
-  //always prefer wider than taller, rotate if necessary
-  if(phen.dy > phen.dx)
-    ClockwiseRotation(phen);
-
-  //iterate through chiral flips
-  bool to_flip=true;
-  while(true) {
-    MinimizePhenRep(phen.tiling);
-    min_tilings.emplace_back(phen.tiling);
-
-    //if dy != dx, then only need to test a single rotation by pi
-    if(phen.dy != phen.dx) {
-      std::reverse(phen.tiling.begin(),phen.tiling.end());
-      MinimizePhenRep(phen.tiling);
-      min_tilings.emplace_back(phen.tiling);
-    }
-    //need to test all four unique rotations
-    else {
-      for(uint8_t rot=0;rot<3;++rot) {
-        ClockwiseRotation(phen);
-        MinimizePhenRep(phen.tiling);
-        min_tilings.emplace_back(phen.tiling);
+//each symmetry is generated straight from the original tiling and relabelled through a lookup table as it is read,
+//and abandoned at the first element where it compares greater than the current minimum
+inline void GetMinPhenRepresentation(Phenotype& phen,uint8_t determinism_level=Phenotype::DETERMINISM_LEVEL) {
+  const uint8_t width=phen.dx, height=phen.dy;
+  const size_t cells=phen.tiling.size();
+  
+  //single tiles and shape-only phenotypes relabel all tiles as 1s, otherwise relabel by first appearance
+  const uint8_t relabel_level=(cells==1 || determinism_level==1) ? 1 : (determinism_level==3 ? 3 : 2);
+  std::array<uint8_t,256> value_labels;
+  std::array<uint8_t,64> group_labels, group_orientations;
+  uint8_t labels_used=0;
+
+  InlineTiling minimum_tiling, candidate_tiling;
+  minimum_tiling.resize(cells);
+  candidate_tiling.resize(cells);
+  bool have_minimum=false;
+  uint8_t minimum_width=width, minimum_height=height;
+
+  //the eight symmetries, as an optional transpose followed by optional reversal of each axis
+  for(uint8_t symmetry=0;symmetry<8;++symmetry) {
+    const bool transpose=symmetry&4, reverse_x=symmetry&1, reverse_y=symmetry&2;
+    const bool reflection=transpose!=(reverse_x!=reverse_y);
+    const uint8_t out_width=transpose ? height : width, out_height=transpose ? width : height;
+
+    //only free polyominoes consider reflections, and always prefer wider than taller
+    if((reflection && !Phenotype::FREE_POLYOMINO) || out_width<out_height)
+      continue;
+    const bool flip_orientation=reflection && determinism_level==3;
+
+    value_labels.fill(0);
+    group_labels.fill(0);
+    labels_used=0;
+    int comparison=have_minimum ? 0 : -1;
+
+    for(size_t out_index=0;out_index<cells;++out_index) {
+      const size_t out_x=out_index%out_width, out_y=out_index/out_width;
+      const size_t source_x=reverse_x ? width-1-(transpose ? out_y : out_x) : (transpose ? out_y : out_x);
+      const size_t source_y=reverse_y ? height-1-(transpose ? out_x : out_y) : (transpose ? out_x : out_y);
+      uint8_t value=phen.tiling[source_y*width+source_x];
+
+      if(value) {
+        if(relabel_level==1)
+          value=1;
+        else {
+          //reflections swap the chiral orientations of tiles
+          if(flip_orientation && value%2==0)
+            value+=-(value-1)%4+((value-1)%4+2)%4;
+          if(relabel_level==2) {
+            if(!value_labels[value])
+              value_labels[value]=++labels_used;
+            value=value_labels[value];
+          }
+          else {
+            const uint8_t group=(value-1)/4, orientation=(value-1)%4;
+            if(!group_labels[group]) {
+              group_labels[group]=1+4*labels_used++;
+              group_orientations[group]=orientation;
+            }
+            value=group_labels[group]+(orientation-group_orientations[group]+4)%4;
+          }
+        }
       }
+      
+      if(comparison==0) {
+        if(value>minimum_tiling[out_index]) {
+          comparison=1;
+          break;
+        }
+        if(value<minimum_tiling[out_index])
+          comparison=-1;
+      }
+      candidate_tiling[out_index]=value;
     }
-    
-    //flip only if first iteration and free polyomino
-    if(to_flip && Phenotype::FREE_POLYOMINO)
-      ChiralFlip(phen);
-    else
-	break;
 
-    to_flip=false;
+    if(comparison<0) {
+      std::swap(minimum_tiling,candidate_tiling);
+      minimum_width=out_width;
+      minimum_height=out_height;
+      have_minimum=true;
+    }
   }
 
   //set tiling to smallest representation
-  phen.tiling=*std::min_element(min_tilings.begin(),min_tilings.end());
+  phen.dx=minimum_width;
+  phen.dy=minimum_height;
+  phen.tiling=std::move(minimum_tiling);
 }
 
-//return the minimal phenotype given a vector of assembled tiles
-inline Phenotype GetPhenotypeFromGrid(std::vector<int8_t>& placed_tiles) {
-  std::vector<int8_t> x_locs, y_locs,tile_vals;
-  x_locs.reserve(placed_tiles.size()/3);y_locs.reserve(placed_tiles.size()/3);tile_vals.reserve(placed_tiles.size()/3);
+//largest bitboard used for shape-only canonicalisation, 8 (one uint64_t) or 16 (sixteen uint16_t rows), or 0 to always use the tiling
+#ifndef POLYOMINO_SHAPE_BOARD
+#define POLYOMINO_SHAPE_BOARD 16
+#endif
+
+//square bitboard of a polyomino shape, with the top row first and column 0 in the highest bit of each row,
+//so comparing the rows in order is the same as comparing the row-major tilings of equally sized shapes
+template<typename Row>
+struct ShapeBoard {
+  static constexpr uint8_t WIDTH=8*sizeof(Row);
+  std::array<Row,WIDTH> rows{};
+
+  inline void Set(uint8_t x,uint8_t y) {rows[y]|=static_cast<Row>(Row(1)<<(WIDTH-1-x));}
+  inline bool Get(uint8_t x,uint8_t y) const {return rows[y]>>(WIDTH-1-x)&1;}
+  inline bool operator<(const ShapeBoard& rhs) const {return rows<rhs.rows;}
+
+  //reflect a shape of the given height top to bottom, keeping it in the top rows
+  inline void FlipRows(uint8_t height) {std::reverse(rows.begin(),rows.begin()+height);}
+
+  //reflect a shape of the given width left to right, keeping it in the leftmost columns
+  inline void FlipColumns(uint8_t width) {
+    for(Row& row : rows)
+      row=static_cast<Row>(ReverseBits(row)<<(WIDTH-width));
+  }
+
+  //swap rows and columns by exchanging ever smaller off-diagonal blocks, log2(WIDTH) rounds of masked shifts
+  inline void Transpose() {
+    Row mask=static_cast<Row>(Row(~Row(0))>>(WIDTH/2));
+    for(uint8_t shift=WIDTH/2;shift;shift>>=1,mask^=static_cast<Row>(mask<<shift))
+      for(uint8_t row=0;row<WIDTH;row=(row+shift+1)&~shift) {
+        const Row exchanged=static_cast<Row>((rows[row]^(rows[row+shift]>>shift))&mask);
+        rows[row]^=exchanged;
+        rows[row+shift]^=static_cast<Row>(exchanged<<shift);
+      }
+  }
+
+private:
+  static inline Row ReverseBits(Row row) {
+    uint32_t bits=row;
+    bits=(bits&0x5555)<<1 | (bits>>1&0x5555);
+    bits=(bits&0x3333)<<2 | (bits>>2&0x3333);
+    bits=(bits&0x0F0F)<<4 | (bits>>4&0x0F0F);
+    if constexpr(WIDTH==16)
+      bits=(bits&0x00FF)<<8 | (bits>>8&0x00FF);
+    return static_cast<Row>(bits);
+  }
+};
+
+//minimal board over the same symmetries as GetMinPhenRepresentation, updating the extent to match
+template<typename Row>
+inline void MinimizeShapeBoard(ShapeBoard<Row>& board,uint8_t& width,uint8_t& height) {
+  ShapeBoard<Row> minimum_board;
+  uint8_t minimum_width=0, minimum_height=0;
+  for(uint8_t symmetry=0;symmetry<8;++symmetry) {
+    const bool transpose=symmetry&4, reverse_x=symmetry&1, reverse_y=symmetry&2;
+    const uint8_t out_width=transpose ? height : width, out_height=transpose ? width : height;
+    if((transpose!=(reverse_x!=reverse_y) && !Phenotype::FREE_POLYOMINO) || out_width<out_height)
+      continue;
+
+    ShapeBoard<Row> candidate_board=board;
+    if(reverse_x)
+      candidate_board.FlipColumns(width);
+    if(reverse_y)
+      candidate_board.FlipRows(height);
+    if(transpose)
+      candidate_board.Transpose();
+    if(!minimum_width || candidate_board<minimum_board) {
+      minimum_board=candidate_board;
+      minimum_width=out_width;
+      minimum_height=out_height;
+    }
+  }
+  board=minimum_board;
+  width=minimum_width;
+  height=minimum_height;
+}
 
-  //seperate out the information in the vector
-  for(std::vector<int8_t>::iterator check_iter = placed_tiles.begin();check_iter!=placed_tiles.end();check_iter+=3) {
-    x_locs.emplace_back(*check_iter);
-    y_locs.emplace_back(*(check_iter+1));
-    tile_vals.emplace_back(*(check_iter+2));
+//extent of a vector of assembled tiles in a single pass over the (x,y,tile) triplets
+inline void PlacedExtent(const std::vector<int8_t>& placed_tiles,int8_t& x_left,int8_t& x_right,int8_t& y_bottom,int8_t& y_top) {
+  x_left=x_right=placed_tiles[0];
+  y_bottom=y_top=placed_tiles[1];
+  for(size_t tile_index=3;tile_index<placed_tiles.size();tile_index+=3) {
+    x_left=std::min(x_left,placed_tiles[tile_index]);
+    x_right=std::max(x_right,placed_tiles[tile_index]);
+    y_bottom=std::min(y_bottom,placed_tiles[tile_index+1]);
+    y_top=std::max(y_top,placed_tiles[tile_index+1]);
   }
+}
+
+//fill a minimal shape board straight from the placed tiles, with width and height already set to their extent
+template<typename Row>
+inline ShapeBoard<Row> PlacedShapeBoard(const std::vector<int8_t>& placed_tiles,int8_t x_left,int8_t y_top,uint8_t& width,uint8_t& height) {
+  ShapeBoard<Row> board;
+  for(size_t tile_index=0;tile_index<placed_tiles.size();tile_index+=3)
+    board.Set(placed_tiles[tile_index]-x_left,y_top-placed_tiles[tile_index+1]);
+  MinimizeShapeBoard(board,width,height);
+  return board;
+}
+
+//call shape_action with the minimal board of the smallest enabled bitboard that fits the extent, returning false if none does
+template<typename ShapeAction>
+inline bool WithShapeBoard(const std::vector<int8_t>& placed_tiles,int8_t x_left,int8_t y_top,uint8_t& width,uint8_t& height,ShapeAction&& shape_action) {
+  if constexpr(POLYOMINO_SHAPE_BOARD>=8)
+    if(width<=8 && height<=8) {
+      shape_action(PlacedShapeBoard<uint8_t>(placed_tiles,x_left,y_top,width,height));
+      return true;
+    }
+  if constexpr(POLYOMINO_SHAPE_BOARD>=16)
+    if(width<=16 && height<=16) {
+      shape_action(PlacedShapeBoard<uint16_t>(placed_tiles,x_left,y_top,width,height));
+      return true;
+    }
+  return false;
+}
+
+//fill a phenotype with the minimal representation of a vector of assembled tiles, reusing the phenotype's storage
+//shape-only phenotypes small enough for a bitboard are canonicalised on the board, giving the same phenotype as the tiling
+inline void GetPhenotypeFromGrid(const std::vector<int8_t>& placed_tiles,Phenotype& phen) {
 
   //get polyomino extent
-  std::vector<int8_t>::iterator x_left,x_right,y_top,y_bottom;
-  std::tie(x_left,x_right)=std::minmax_element(x_locs.begin(),x_locs.end());
-  std::tie(y_bottom,y_top)=std::minmax_element(y_locs.begin(),y_locs.end());
-  uint8_t dx=*x_right-*x_left+1,dy=*y_top-*y_bottom+1;
-  std::vector<uint8_t> spatial_grid(dx*dy);
+  int8_t x_left,x_right,y_bottom,y_top;
+  PlacedExtent(placed_tiles,x_left,x_right,y_bottom,y_top);
+  phen.dx=x_right-x_left+1;
+  phen.dy=y_top-y_bottom+1;
+
+  if(Phenotype::DETERMINISM_LEVEL==1 && WithShapeBoard(placed_tiles,x_left,y_top,phen.dx,phen.dy,[&phen](const auto& board) {
+        phen.tiling.resize(phen.dx*phen.dy);
+        for(uint8_t y=0;y<phen.dy;++y)
+          for(uint8_t x=0;x<phen.dx;++x)
+            phen.tiling[y*phen.dx+x]=board.Get(x,y);}))
+    return;
+  phen.tiling.assign(phen.dx*phen.dy,0);
   
   //assign polyomino tile details based on level of determinism
-  for(uint16_t tileIndex=0;tileIndex<x_locs.size();++tileIndex) {
+  for(size_t tile_index=0;tile_index<placed_tiles.size();tile_index+=3) {
+    const int8_t tile_value=placed_tiles[tile_index+2];
     uint8_t tile_detail=0;
     switch(Phenotype::DETERMINISM_LEVEL) {
     case 1:
-      tile_detail=tile_vals[tileIndex] > 0 ? 1 : 0;
+      tile_detail=tile_value > 0 ? 1 : 0;
       break;
     case 2:
-      tile_detail=tile_vals[tileIndex] > 0 ? (tile_vals[tileIndex]-1)/4+1 : 0;
+      tile_detail=tile_value > 0 ? (tile_value-1)/4+1 : 0;
       break;
     case 3:
 	[[fallthrough]];
     default:
-      tile_detail=tile_vals[tileIndex];
+      tile_detail=tile_value;
     }
-    spatial_grid[(*y_top-y_locs[tileIndex])*dx + (x_locs[tileIndex]-*x_left)]=tile_detail;
+    phen.tiling[(y_top-placed_tiles[tile_index+1])*phen.dx + (placed_tiles[tile_index]-x_left)]=tile_detail;
   }
 
   //find the minimum representation for consistency
-  Phenotype phen{dx,dy,spatial_grid};
   GetMinPhenRepresentation(phen);
+}
+
+//return the minimal phenotype given a vector of assembled tiles
+inline Phenotype GetPhenotypeFromGrid(const std::vector<int8_t>& placed_tiles) {
+  Phenotype phen;
+  GetPhenotypeFromGrid(placed_tiles,phen);
   return phen;
 }
 
+//hash of the shape alone, the PhenotypeHash of the shape-only phenotype, so phenotypes that are equal at any determinism level share it
+//computed on a bitboard straight from the placed tiles when the extent fits one, e.g. for grouping assemblies by shape
+//the phenotype tables do not use it, as their lookups are keyed on the full PhenotypeHash
+inline uint64_t ShapeHash(const std::vector<int8_t>& placed_tiles) {
+  int8_t x_left,x_right,y_bottom,y_top;
+  PlacedExtent(placed_tiles,x_left,x_right,y_bottom,y_top);
+  uint8_t width=x_right-x_left+1, height=y_top-y_bottom+1;
+
+  uint64_t hash_value=14695981039346656037ULL;
+  const auto mix=[&hash_value](uint8_t byte) {hash_value=(hash_value^byte)*1099511628211ULL;};
+  if(WithShapeBoard(placed_tiles,x_left,y_top,width,height,[&](const auto& board) {
+        mix(width);
+        mix(height);
+        for(uint8_t y=0;y<height;++y)
+          for(uint8_t x=0;x<width;++x)
+            mix(board.Get(x,y));}))
+    return hash_value;
+
+  Phenotype shape(width,height,std::vector<uint8_t>(width*height,0));
+  for(size_t tile_index=0;tile_index<placed_tiles.size();tile_index+=3)
+    shape.tiling[(y_top-placed_tiles[tile_index+1])*width+(placed_tiles[tile_index]-x_left)]=1;
+  GetMinPhenRepresentation(shape,1);
+  return PhenotypeHash(shape);
+}
+
+//hashed index over a per-size phenotype vector, mapping the phenotype hash to its position in that vector
+struct PhenotypeIndex {
+  std::unordered_multimap<uint64_t,uint16_t> hashed_positions;
+  size_t indexed_size=0;
+
+  //bring the index up to date with the vector, catching phenotypes appended outside the table methods
+  inline void Synchronise(const std::vector<Phenotype>& phenotypes) {
+    if(phenotypes.size()<indexed_size)
+      Clear();
+    for(;indexed_size<phenotypes.size();++indexed_size)
+      hashed_positions.emplace(PhenotypeHash(phenotypes[indexed_size]),static_cast<uint16_t>(indexed_size));
+  }
+
+  //record a phenotype that has just been appended to the indexed vector
+  inline void Append(uint64_t phen_hash) {
+    hashed_positions.emplace(phen_hash,static_cast<uint16_t>(indexed_size++));
+  }
+
+  //position of a matching phenotype, or the vector size if there is no match
+  inline size_t Find(const Phenotype& phen,uint64_t phen_hash,const std::vector<Phenotype>& phenotypes) const {
+    auto [match,last_match]=hashed_positions.equal_range(phen_hash);
+    [[maybe_unused]] size_t probes=0;
+    for(;match!=last_match;++match) {
+      ++probes;
+      if(phenotypes[match->second]==phen) {
+        POLYOMINO_METRIC_RECORD(PhenotypeProbeDepth,probes);
+        return match->second;
+      }
+    }
+    POLYOMINO_METRIC_RECORD(PhenotypeProbeDepth,probes);
+    return phenotypes.size();
+  }
+
+  inline void Clear() {
+    hashed_positions.clear();
+    indexed_size=0;
+  }
+};
+
+//frequency of each phenotype in a vector of pids against any table, see PhenotypeTable::PhenotypeFrequencies
+template<class Table>
+inline void CountPhenotypeFrequencies(const Table& table,const std::vector<Phenotype_ID >& pids,std::vector<std::pair<Phenotype_ID,uint16_t> >& ID_counts,const Phenotype_ID RARE_pid, bool allow_existing) {
+  const uint16_t thresh_val=std::ceil(Table::UND_threshold*Table::phenotype_builds);
+  thread_local std::vector<Phenotype_ID> sorted_pids;
+  sorted_pids.assign(pids.begin(),pids.end());
+  std::sort(sorted_pids.begin(),sorted_pids.end());
+
+  //count runs of equal pids, keeping those common enough, or already known if allow_existing is true
+  ID_counts.clear();
+  bool stripped=false;
+  for(auto run_start=sorted_pids.begin();run_start!=sorted_pids.end();) {
+    const auto run_end=std::find_if(run_start,sorted_pids.end(),[run_start](const Phenotype_ID& pid){return pid!=*run_start;});
+    const uint16_t count=static_cast<uint16_t>(run_end-run_start);
+    if(count >= thresh_val || (allow_existing && table.IsKnown(*run_start)))
+      ID_counts.emplace_back(*run_start,count);
+    else
+      stripped=true;
+    run_start=run_end;
+  }
+  if(stripped) {
+    auto rare_iter=std::lower_bound(ID_counts.begin(),ID_counts.end(),RARE_pid,[](const auto& entry,const Phenotype_ID& pid){return entry.first<pid;});
+    if(rare_iter!=ID_counts.end() && rare_iter->first==RARE_pid)
+      ++rare_iter->second;
+    else
+      ID_counts.emplace(rare_iter,RARE_pid,1);
+  }
+}
+
 //main structure to record information on phenotypes of interest, as well as properties determining assembly
 struct PhenotypeTable {
 
@@ -211,61 +605,143 @@ struct PhenotypeTable {
 protected:
   std::unordered_map<uint8_t,std::vector<Phenotype>> undiscovered_phenotypes;
   std::unordered_map<uint8_t, std::vector<uint16_t>> undiscovered_phenotype_counts;
+
+  //hashed lookups into the per-size vectors, kept in step with them lazily
+  std::unordered_map<uint8_t,PhenotypeIndex> known_index, undiscovered_index;
+
+  //temporary to permanent pids from the last promotion, for each size a dense range starting from the first temporary pid
+  static constexpr uint16_t NOT_PROMOTED=UINT16_MAX;
+  struct PromotedRange {
+    size_t temporary_start=0;
+    std::vector<uint16_t> permanent_pids;
+  };
+  std::array<PromotedRange,256> promotions;
+  bool promoted=false;
+
+  inline void RecordPromotion(uint8_t phenotype_size,size_t temporary_start,size_t temporary_offset,size_t permanent_pid) {
+    PromotedRange& range=promotions[phenotype_size];
+    range.temporary_start=temporary_start;
+    if(temporary_offset>=range.permanent_pids.size())
+      range.permanent_pids.resize(temporary_offset+1,NOT_PROMOTED);
+    range.permanent_pids[temporary_offset]=static_cast<uint16_t>(permanent_pid);
+  }
+
+  inline void ResetPromotions() {
+    for(PromotedRange& range : promotions)
+      range.permanent_pids.clear();
+    promoted=false;
+  }
+
+  inline Phenotype_ID PromotedPID(Phenotype_ID pid) const {
+    const PromotedRange& range=promotions[pid.first];
+    if(pid.second>=range.temporary_start && pid.second-range.temporary_start<range.permanent_pids.size())
+      if(const uint16_t permanent_pid=range.permanent_pids[pid.second-range.temporary_start]; permanent_pid!=NOT_PROMOTED)
+        return Phenotype_ID{pid.first,permanent_pid};
+    return pid;
+  }
+
+  //rewrite map keys in one sweep, which keeps them in order unless a promotion overtook an unpromoted temporary pid
+  template<typename map_val>
+  inline void RelabelMapKeys(std::map<Phenotype_ID, map_val>& map) const {
+    std::map<Phenotype_ID, map_val> relabelled_map;
+    for(auto& kv : map) {
+      const Phenotype_ID relabelled_pid=PromotedPID(kv.first);
+      if(relabelled_map.empty() || relabelled_map.rbegin()->first<relabelled_pid)
+        relabelled_map.emplace_hint(relabelled_map.end(),relabelled_pid,std::move(kv.second));
+      else
+        relabelled_map.emplace(relabelled_pid,std::move(kv.second));
+    }
+    map.swap(relabelled_map);
+  }
+
+  //add common enough temporary phenotypes to the known table, recording where each one went
+  inline void PromoteUndiscovered() {
+    if(promoted)
+      return;
+    promoted=true;
+    const uint16_t thresh_val=std::ceil(UND_threshold*phenotype_builds);
+    for(auto& kv : undiscovered_phenotype_counts) {
+      std::vector<Phenotype>& known_bucket=known_phenotypes[kv.first];
+      const size_t table_size=known_bucket.size(); 
+      for(size_t nth=0; nth<kv.second.size(); ++nth)
+        if(kv.second[nth] >= thresh_val) {
+          RecordPromotion(kv.first,table_size+phenotype_builds,nth,known_bucket.size());
+          known_bucket.emplace_back(undiscovered_phenotypes[kv.first][nth]);
+          POLYOMINO_METRIC_COUNT(PhenotypePromotions,1);
+        }
+    }
+  }
 public:
   std::unordered_map<uint8_t,std::vector<Phenotype> > known_phenotypes;
   
+  //permanent pids keep their label through relabelling, unlike temporary ones
+  inline bool IsKnown(Phenotype_ID pid) const {
+    auto bucket_iter=known_phenotypes.find(pid.first);
+    return bucket_iter!=known_phenotypes.end() && pid.second<bucket_iter->second.size();
+  }
 
   
   inline Phenotype_ID GetPhenotypeID(Phenotype& phen) {
     
     //get phenotype size
     uint8_t phenotype_size=std::count_if(phen.tiling.begin(),phen.tiling.end(),[](const int c){return c != 0;});
+    const uint64_t phen_hash=PhenotypeHash(phen);
+    POLYOMINO_METRIC_COUNT(PhenotypeLookups,1);
     
     //compare against existing table entries, return pid if it exists
-    for(size_t phenotype_index=0; phenotype_index != known_phenotypes[phenotype_size].size();++phenotype_index)
-      if(phen==known_phenotypes[phenotype_size][phenotype_index]) 
-        return Phenotype_ID{phenotype_size,phenotype_index};
+    const std::vector<Phenotype>& known_bucket=known_phenotypes[phenotype_size];
+    PhenotypeIndex& known_lookup=known_index[phenotype_size];
+    known_lookup.Synchronise(known_bucket);
+    const size_t phenotype_index=known_lookup.Find(phen,phen_hash,known_bucket);
+    if(phenotype_index!=known_bucket.size())
+      return Phenotype_ID{phenotype_size,phenotype_index};
 
     //if not match found and table is fixed, return a default value
     if(FIXED_TABLE)
       return NULL_pid;
+    assert(!promoted && "phenotypes classified after RelabelPIDs need ClearIncomplete first");
   
     //compare against temporary table entries
-    uint16_t new_phenotype_index=0;
-    while(new_phenotype_index<undiscovered_phenotypes[phenotype_size].size()) { 
-      if(phen==undiscovered_phenotypes[phenotype_size][new_phenotype_index])
-        goto found_phen;
-      ++new_phenotype_index;
-    }
-    
+    std::vector<Phenotype>& undiscovered_bucket=undiscovered_phenotypes[phenotype_size];
+    PhenotypeIndex& undiscovered_lookup=undiscovered_index[phenotype_size];
+    undiscovered_lookup.Synchronise(undiscovered_bucket);
+    const size_t new_phenotype_index=undiscovered_lookup.Find(phen,phen_hash,undiscovered_bucket);
+
     //not in temporary either, add to temporary
-    undiscovered_phenotypes[phenotype_size].emplace_back(phen);
-    undiscovered_phenotype_counts[phenotype_size].emplace_back(0);
+    if(new_phenotype_index==undiscovered_bucket.size()) {
+      undiscovered_bucket.emplace_back(phen);
+      undiscovered_phenotype_counts[phenotype_size].emplace_back(0);
+      undiscovered_lookup.Append(phen_hash);
+    }
 
     //increment the count for the temporary and return its temporary pid
-  found_phen:
     ++undiscovered_phenotype_counts[phenotype_size][new_phenotype_index];
-    return Phenotype_ID{phenotype_size,known_phenotypes[phenotype_size].size()+new_phenotype_index+phenotype_builds};
+    return Phenotype_ID{phenotype_size,known_bucket.size()+new_phenotype_index+phenotype_builds};
   }
 
   //helper function to reset temporary trackers
   inline void ClearIncomplete() {
     undiscovered_phenotypes.clear();
     undiscovered_phenotype_counts.clear();
+    undiscovered_index.clear();
+    ResetPromotions();
+  }
+
+  //drop every known and temporary phenotype, e.g. before loading a table in place
+  inline void ClearTable() {
+    known_phenotypes.clear();
+    known_index.clear();
+    ClearIncomplete();
   }
 
   //relabel temporary pids if sufficiently common to known_phenotypes
+  //the promotion happens once until the table is cleared, later calls (and RelabelMaps) reuse the same temporary to permanent mapping
+  //so within a generation, every GetPhenotypeID call comes before the first relabel, and each pid vector or map is relabelled once,
+  //as temporary pids are only unique until ClearIncomplete and a relabelled pid can fall in the temporary range
   inline void RelabelPIDs(std::vector<Phenotype_ID >& pids,bool clear=false) {
-    const uint16_t thresh_val=std::ceil(UND_threshold*phenotype_builds);
-    for(auto& kv : undiscovered_phenotype_counts) {
-      const size_t table_size=known_phenotypes[kv.first].size(); 
-      for(size_t nth=0; nth<kv.second.size(); ++nth)
-	//if common enough, change pid and add to main map
-        if(kv.second[nth] >= thresh_val) {
-          std::replace(pids.begin(),pids.end(),Phenotype_ID{kv.first,table_size+phenotype_builds+nth},Phenotype_ID{kv.first,known_phenotypes[kv.first].size()});
-          known_phenotypes[kv.first].emplace_back(undiscovered_phenotypes[kv.first][nth]);
-        }
-    }
+    PromoteUndiscovered();
+    for(Phenotype_ID& pid : pids)
+      pid=PromotedPID(pid);
     if(clear)
       ClearIncomplete();
   }
@@ -273,48 +749,23 @@ public:
   //relabel templated map, same concept as RelabelPIDs
   template<typename map_val>
   inline void RelabelMaps(std::map<Phenotype_ID, map_val>& map, bool clear=false) {
- const uint16_t thresh_val=std::ceil(UND_threshold*phenotype_builds);
-    for(auto& kv : undiscovered_phenotype_counts) {
-      const size_t table_size=known_phenotypes[kv.first].size(); 
-      size_t back_counts=1;
-      for(size_t nth=1; nth<=kv.second.size(); ++nth)
-        if(kv.second[kv.second.size()-nth] >= thresh_val) {
-	auto nh = map.extract(Phenotype_ID{kv.first,table_size+phenotype_builds-back_counts});
-	nh.key() = {kv.first,known_phenotypes[kv.first].size()-back_counts};
-	map.insert(std::move(nh));
-	++back_counts;
-        }
-      
-    }
+    PromoteUndiscovered();
+    RelabelMapKeys(map);
     if(clear)
       ClearIncomplete();
-
-
   }
 
-  
   //find the frequency of each phenotype in a vector of pids, stripping pids that were below a threshold and adding a rare pid
-  inline std::map<Phenotype_ID,uint16_t> PhenotypeFrequencies(std::vector<Phenotype_ID >& pids,const Phenotype_ID RARE_pid=NULL_pid, bool allow_existing=false) { 
-    const uint16_t thresh_val=std::ceil(UND_threshold*phenotype_builds);
-    std::map<Phenotype_ID, uint16_t> ID_counter;
-
-    //get count of each pid in the vector
-    for(auto& pid : pids)
-      ++ID_counter[pid];
-
-    //erase pids that were not common enough, or allow them to survive if allow_existing is true
-    const size_t all_size= ID_counter.size();
-    for(auto map_it = ID_counter.begin(); map_it != ID_counter.end();) {
-      if(map_it->second >= thresh_val || (allow_existing && map_it->first.second < known_phenotypes[map_it->first.first].size())) 
-        ++map_it;
-      else
-	map_it=ID_counter.erase(map_it);
-        
-    }
-    if(ID_counter.size()!=all_size)
-      ++ID_counter[RARE_pid];
+  //fills a flat (pid,count) vector sorted by pid, reusing its storage
+  inline void PhenotypeFrequencies(const std::vector<Phenotype_ID >& pids,std::vector<std::pair<Phenotype_ID,uint16_t> >& ID_counts,const Phenotype_ID RARE_pid=NULL_pid, bool allow_existing=false) const {
+    CountPhenotypeFrequencies(*this,pids,ID_counts,RARE_pid,allow_existing);
+  }
 
-    return ID_counter;    
+  //as above, returned as a map
+  inline std::map<Phenotype_ID,uint16_t> PhenotypeFrequencies(std::vector<Phenotype_ID >& pids,const Phenotype_ID RARE_pid=NULL_pid, bool allow_existing=false) { 
+    thread_local std::vector<std::pair<Phenotype_ID,uint16_t> > ID_counts;
+    PhenotypeFrequencies(pids,ID_counts,RARE_pid,allow_existing);
+    return std::map<Phenotype_ID,uint16_t>(ID_counts.begin(),ID_counts.end());
   }
 
   //fill a fixed or unfixed table with details from a give file name
@@ -344,3 +795,153 @@ public:
     }
   }
 };
+
+//thread-safe PhenotypeTable, so several threads can classify assemblies within the same generation
+//known phenotypes are only read during a generation (under a shared lock), while undiscovered phenotypes are spread over independently locked shards
+//undiscovered phenotypes are promoted by RelabelPIDs at the generation boundary, in a canonical order so the resulting pids do not depend on thread scheduling
+struct ConcurrentPhenotypeTable : PhenotypeTable {
+
+  static constexpr uint16_t SHARD_COUNT=16;
+
+  inline Phenotype_ID GetPhenotypeID(Phenotype& phen) {
+    uint8_t phenotype_size=std::count_if(phen.tiling.begin(),phen.tiling.end(),[](const int c){return c != 0;});
+    const uint64_t phen_hash=PhenotypeHash(phen);
+    POLYOMINO_METRIC_COUNT(PhenotypeLookups,1);
+    size_t known_size=0;
+
+    //compare against existing table entries, catching up the index under an exclusive lock if the table was appended to
+    {
+      std::shared_lock<std::shared_mutex> read_lock(known_mutex);
+      if(!KnownIndexCurrent(phenotype_size)) {
+        read_lock.unlock();
+        std::unique_lock<std::shared_mutex> write_lock(known_mutex);
+        known_index[phenotype_size].Synchronise(known_phenotypes[phenotype_size]);
+        write_lock.unlock();
+        read_lock.lock();
+      }
+      //an empty bucket (e.g. made by indexing known_phenotypes) is current without an index, and holds nothing to find
+      auto bucket_iter=known_phenotypes.find(phenotype_size);
+      auto index_iter=known_index.find(phenotype_size);
+      if(bucket_iter!=known_phenotypes.end() && index_iter!=known_index.end()) {
+        known_size=bucket_iter->second.size();
+        const size_t phenotype_index=index_iter->second.Find(phen,phen_hash,bucket_iter->second);
+        if(phenotype_index!=known_size)
+          return Phenotype_ID{phenotype_size,phenotype_index};
+      }
+    }
+
+    //if not match found and table is fixed, return a default value
+    if(FIXED_TABLE)
+      return NULL_pid;
+    assert(!promoted && "phenotypes classified after RelabelPIDs need ClearIncomplete first");
+
+    //compare against, or add to, the temporary entries of the shard owning this hash
+    const uint16_t shard_index=phen_hash%SHARD_COUNT;
+    UndiscoveredShard& shard=shards[shard_index];
+    std::lock_guard<std::mutex> shard_lock(shard.shard_mutex);
+    std::vector<Phenotype>& shard_bucket=shard.phenotypes[phenotype_size];
+    PhenotypeIndex& shard_lookup=shard.index[phenotype_size];
+    const size_t local_index=shard_lookup.Find(phen,phen_hash,shard_bucket);
+    if(local_index==shard_bucket.size()) {
+      shard_bucket.emplace_back(phen);
+      shard.counts[phenotype_size].emplace_back(0);
+      shard_lookup.Append(phen_hash);
+    }
+    ++shard.counts[phenotype_size][local_index];
+
+    //temporary pids interleave the shards, so they are unique across the whole table
+    return Phenotype_ID{phenotype_size,known_size+phenotype_builds+local_index*SHARD_COUNT+shard_index};
+  }
+
+  //reset temporary trackers in every shard
+  inline void ClearIncomplete() {
+    std::unique_lock<std::shared_mutex> write_lock(known_mutex);
+    for(UndiscoveredShard& shard : shards) {
+      std::lock_guard<std::mutex> shard_lock(shard.shard_mutex);
+      shard.phenotypes.clear();
+      shard.counts.clear();
+      shard.index.clear();
+    }
+    ResetPromotions();
+  }
+
+  //drop every known phenotype, and the temporary ones in every shard
+  inline void ClearTable() {
+    {
+      std::unique_lock<std::shared_mutex> write_lock(known_mutex);
+      known_phenotypes.clear();
+      known_index.clear();
+    }
+    ClearIncomplete();
+  }
+
+  //promote sufficiently common temporary phenotypes (once per generation), and relabel their pids
+  //may be called on several pid vectors before clearing, each is relabelled with the same mapping, under the same contract as PhenotypeTable::RelabelPIDs
+  inline void RelabelPIDs(std::vector<Phenotype_ID >& pids,bool clear=false) {
+    MergeUndiscovered();
+    for(Phenotype_ID& pid : pids)
+      pid=PromotedPID(pid);
+    if(clear)
+      ClearIncomplete();
+  }
+
+  //relabel templated map, same concept as RelabelPIDs
+  template<typename map_val>
+  inline void RelabelMaps(std::map<Phenotype_ID, map_val>& map, bool clear=false) {
+    MergeUndiscovered();
+    RelabelMapKeys(map);
+    if(clear)
+      ClearIncomplete();
+  }
+
+private:
+  struct UndiscoveredShard {
+    std::mutex shard_mutex;
+    std::unordered_map<uint8_t,std::vector<Phenotype>> phenotypes;
+    std::unordered_map<uint8_t,std::vector<uint16_t>> counts;
+    std::unordered_map<uint8_t,PhenotypeIndex> index;
+  };
+
+  std::array<UndiscoveredShard,SHARD_COUNT> shards;
+  std::shared_mutex known_mutex;
+
+  inline bool KnownIndexCurrent(uint8_t phenotype_size) const {
+    auto bucket_iter=known_phenotypes.find(phenotype_size);
+    auto index_iter=known_index.find(phenotype_size);
+    const size_t bucket_size=bucket_iter==known_phenotypes.end() ? 0 : bucket_iter->second.size();
+    return index_iter==known_index.end() ? bucket_size==0 : index_iter->second.indexed_size==bucket_size;
+  }
+
+  //gather the shards and add common enough phenotypes to the known table, ordered by (dx,dy,tiling) for determinism
+  inline void MergeUndiscovered() {
+    std::unique_lock<std::shared_mutex> write_lock(known_mutex);
+    if(promoted)
+      return;
+    promoted=true;
+    
+    const uint16_t thresh_val=std::ceil(UND_threshold*phenotype_builds);
+    std::unordered_map<uint8_t,std::vector<std::pair<const Phenotype*,uint16_t>>> candidates;
+    for(uint16_t shard_index=0;shard_index<SHARD_COUNT;++shard_index) {
+      UndiscoveredShard& shard=shards[shard_index];
+      std::lock_guard<std::mutex> shard_lock(shard.shard_mutex);
+      for(auto& kv : shard.counts)
+        for(size_t nth=0; nth<kv.second.size(); ++nth)
+          if(kv.second[nth] >= thresh_val)
+            candidates[kv.first].emplace_back(&shard.phenotypes[kv.first][nth],nth*SHARD_COUNT+shard_index);
+    }
+
+    for(auto& kv : candidates) {
+      std::sort(kv.second.begin(),kv.second.end(),[](const auto& left,const auto& right){
+          const Phenotype& lhs=*left.first, &rhs=*right.first;
+          return std::tie(lhs.dx,lhs.dy,lhs.tiling) < std::tie(rhs.dx,rhs.dy,rhs.tiling);});
+      std::vector<Phenotype>& known_bucket=known_phenotypes[kv.first];
+      const size_t table_size=known_bucket.size();
+      for(const auto& [phen,local_pid] : kv.second) {
+        RecordPromotion(kv.first,table_size+phenotype_builds,local_pid,known_bucket.size());
+        known_bucket.emplace_back(*phen);
+      }
+      POLYOMINO_METRIC_COUNT(PhenotypePromotions,kv.second.size());
+      known_index[kv.first].Synchronise(known_bucket);
+    }
+  }
+};
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+
+//counter-based Philox4x32-10 generator, where each stream is fixed by its key (the run seed) and counter (the stream indices)
+//streams are keyed by (seed, generation, genotype index, build index), so any draw can be reproduced without replaying earlier ones,
+//and results do not depend on which thread evaluates which genotype
+//state is 32 bytes and construction is free, so a new stream can be made for every build
+//satisfies UniformRandomBitGenerator, and so can be passed to any std distribution in place of RNG_Engine
+class Philox4x32 {
+public:
+  using result_type=uint32_t;
+
+  //reserved stream indices for draws not tied to a single genotype or build
+  static constexpr uint32_t MUTATION_STREAM=std::numeric_limits<uint32_t>::max();
+  static constexpr uint32_t SELECTION_STREAM=std::numeric_limits<uint32_t>::max();
+  static constexpr uint32_t FITNESS_STREAM=std::numeric_limits<uint32_t>::max();
+
+  Philox4x32(uint64_t seed,uint32_t generation=0,uint32_t genotype_index=0,uint32_t build_index=0) :
+    key{static_cast<uint32_t>(seed),static_cast<uint32_t>(seed>>32)}, counter{0,build_index,genotype_index,generation} {}
+
+  static constexpr result_type min() {return std::numeric_limits<result_type>::min();}
+  static constexpr result_type max() {return std::numeric_limits<result_type>::max();}
+
+  inline result_type operator()() {
+    if(output_index==4) {
+      GenerateBlock();
+      output_index=0;
+    }
+    return output[output_index++];
+  }
+
+  inline void discard(unsigned long long skip) {
+    for(;skip && output_index!=4;--skip)
+      ++output_index;
+    counter[0]+=static_cast<uint32_t>(skip/4);
+    if(skip%4) {
+      GenerateBlock();
+      output_index=skip%4;
+    }
+  }
+
+private:
+  static constexpr uint32_t MULTIPLIER_0=0xD2511F53, MULTIPLIER_1=0xCD9E8D57;
+  static constexpr uint32_t WEYL_0=0x9E3779B9, WEYL_1=0xBB67AE85;
+  static constexpr uint8_t ROUNDS=10;
+
+  uint32_t key[2];
+  uint32_t counter[4];
+  uint32_t output[4];
+  uint8_t output_index=4;
+
+  //encrypt the current counter into the next four outputs, then advance the block counter
+  inline void GenerateBlock() {
+    uint32_t block[4]={counter[0],counter[1],counter[2],counter[3]};
+    uint32_t round_key[2]={key[0],key[1]};
+    for(uint8_t round=0;round<ROUNDS;++round) {
+      const uint64_t product_0=static_cast<uint64_t>(MULTIPLIER_0)*block[0], product_1=static_cast<uint64_t>(MULTIPLIER_1)*block[2];
+      const uint32_t mixed[4]={static_cast<uint32_t>(product_1>>32)^block[1]^round_key[0],static_cast<uint32_t>(product_1),
+                               static_cast<uint32_t>(product_0>>32)^block[3]^round_key[1],static_cast<uint32_t>(product_0)};
+      for(uint8_t word=0;word<4;++word)
+        block[word]=mixed[word];
+      round_key[0]+=WEYL_0;
+      round_key[1]+=WEYL_1;
+    }
+    for(uint8_t word=0;word<4;++word)
+      output[word]=block[word];
+    ++counter[0];
+  }
+};
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <random>
+#include <limits>
+#include <type_traits>
+#include "core_phenotype.hpp"
+#include "core_genotype.hpp"
+#include "core_evolution.hpp"
+
+//reference model with fixed-width integer interfaces, for benchmarking and as a minimal example of extending the core
+//interfaces bind to the bit-reversed complement of their partner, with strength 1-d/L for Hamming distance d between them over L bits
+//pairs weaker than binding_threshold do not interact
+template<typename T>
+class HammingAssembly : public PolyominoAssembly<HammingAssembly<T>> {
+  static_assert(std::is_unsigned<T>::value,"interfaces must be unsigned integers");
+
+public:
+  using interface_type = T;
+  using Genotype = std::vector<interface_type>;
+
+  static constexpr uint8_t interface_size=8*sizeof(T);
+  inline static double binding_threshold=.75;
+  //chance for each bit of an interface to flip during Mutation
+  inline static double mutation_rate=1./interface_size;
+
+  static constexpr bool bitstring_interactions=true;
+
+  static inline interface_type ReverseBits(interface_type value) {
+    interface_type reversed=0;
+    for(uint8_t bit=0;bit<interface_size;++bit,value>>=1)
+      reversed=static_cast<interface_type>(reversed<<1 | (value&1));
+    return reversed;
+  }
+
+  //the interface that binds perfectly to the given one
+  static inline interface_type PerfectPartner(interface_type value) {
+    return static_cast<interface_type>(~ReverseBits(value));
+  }
+
+  static inline interface_type BindingKey(interface_type value) {
+    return PerfectPartner(value);
+  }
+
+  static inline double MismatchStrength(uint8_t mismatches) {
+    const double strength=1-static_cast<double>(mismatches)/interface_size;
+    return strength>=binding_threshold ? strength : 0;
+  }
+
+  static inline double InteractionMatrix(interface_type face_1,interface_type face_2) {
+    return MismatchStrength(static_cast<uint8_t>(__builtin_popcountll(face_1^BindingKey(face_2))));
+  }
+
+  template<typename URBG>
+  static inline interface_type GenRandomSite(URBG& rng) {
+    return static_cast<interface_type>(std::uniform_int_distribution<uint64_t>(0,std::numeric_limits<interface_type>::max())(rng));
+  }
+  static inline interface_type GenRandomSite() {
+    return GenRandomSite(RNG_Engine);
+  }
+
+  //flip bits independently with probability mutation_rate, skipping between flips geometrically
+  template<typename URBG>
+  static inline void Mutation(Genotype& genotype,URBG& rng) {
+    if(!(mutation_rate>0))
+      return;
+    std::geometric_distribution<size_t> gap(mutation_rate);
+    const size_t bits=genotype.size()*interface_size;
+    for(size_t bit=gap(rng);bit<bits;bit+=1+gap(rng))
+      genotype[bit/interface_size]^=static_cast<interface_type>(interface_type(1)<<(bit%interface_size));
+  }
+  static inline void Mutation(Genotype& genotype) {
+    Mutation(genotype,RNG_Engine);
+  }
+};
@@ -0,0 +1,440 @@
+#pragma once
+#include "core_phenotype.hpp"
+#include "core_genotype.hpp"
+#include "core_table_io.hpp"
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <type_traits>
+
+//compile with -DPOLYOMINO_ZLIB=1 (and link zlib) to allow compressed columns
+#ifndef POLYOMINO_ZLIB
+#define POLYOMINO_ZLIB 0
+#endif
+#if POLYOMINO_ZLIB
+#include <zlib.h>
+#endif
+
+//columnar binary output, written in chunks of rows by a background thread so simulation threads never format or wait on the disk
+//  header | column directory | chunk | chunk | ...
+//each chunk holds one block per fixed-width column and two per ragged column (per-row lengths, then the concatenated values)
+//blocks start on 8 byte boundaries, and uncompressed blocks can be viewed in place (e.g. numpy.memmap in scripts/polyomino_visuals.py)
+//all values are stored in native byte order, recorded in each column's numpy dtype string
+struct StreamFileHeader {
+  static constexpr char MAGIC[8]={'P','O','L','Y','S','T','R','M'};
+  static constexpr uint32_t VERSION=1;
+
+  char magic[8];
+  uint32_t version, column_count;
+};
+
+//width is the number of values per row, or 0 for ragged columns with any number per row
+struct StreamColumnHeader {
+  char name[48];
+  char dtype[8];
+  uint32_t width, padding;
+};
+
+struct StreamChunkHeader {
+  static constexpr char MAGIC[4]={'C','H','N','K'};
+
+  char magic[4];
+  uint32_t block_count;
+  uint64_t rows, payload_bytes;
+};
+
+struct StreamBlockHeader {
+  static constexpr uint32_t RAW=0, ZLIB=1;
+
+  uint64_t count, stored_bytes;
+  uint32_t codec, padding;
+};
+
+//numpy dtype string for a fixed-width arithmetic type, e.g. "<u2"
+template<typename T>
+inline std::array<char,8> StreamDtype() {
+  static_assert(std::is_arithmetic<T>::value && sizeof(T)<=8,"stream columns hold integer or floating point values");
+  const char byte_order=sizeof(T)==1 ? '|' : (__BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__ ? '<' : '>');
+  const char kind=std::is_floating_point<T>::value ? 'f' : (std::is_signed<T>::value ? 'i' : 'u');
+  return {byte_order,kind,static_cast<char>('0'+sizeof(T)),0,0,0,0,0};
+}
+
+//bounded multi-producer multi-consumer queue without locks (Vyukov's sequenced ring)
+//each cell's sequence number says whether it is free for the push at that position or full for the pop at that position
+template<typename T>
+class BoundedQueue {
+public:
+  explicit BoundedQueue(size_t capacity) {
+    size_t cell_count=2;
+    while(cell_count<capacity)
+      cell_count<<=1;
+    cells.reset(new Cell[cell_count]);
+    mask=cell_count-1;
+    for(size_t cell=0;cell<cell_count;++cell)
+      cells[cell].sequence.store(cell,std::memory_order_relaxed);
+  }
+
+  //returns false if the queue is full
+  inline bool TryPush(T& value) {
+    size_t position=push_position.load(std::memory_order_relaxed);
+    Cell* cell;
+    for(;;) {
+      cell=&cells[position&mask];
+      const intptr_t lag=static_cast<intptr_t>(cell->sequence.load(std::memory_order_acquire))-static_cast<intptr_t>(position);
+      if(lag==0 && push_position.compare_exchange_weak(position,position+1,std::memory_order_relaxed))
+        break;
+      if(lag<0)
+        return false;
+      if(lag>0)
+        position=push_position.load(std::memory_order_relaxed);
+    }
+    cell->value=std::move(value);
+    cell->sequence.store(position+1,std::memory_order_release);
+    return true;
+  }
+
+  //returns false if the queue is empty
+  inline bool TryPop(T& value) {
+    size_t position=pop_position.load(std::memory_order_relaxed);
+    Cell* cell;
+    for(;;) {
+      cell=&cells[position&mask];
+      const intptr_t lag=static_cast<intptr_t>(cell->sequence.load(std::memory_order_acquire))-static_cast<intptr_t>(position+1);
+      if(lag==0 && pop_position.compare_exchange_weak(position,position+1,std::memory_order_relaxed))
+        break;
+      if(lag<0)
+        return false;
+      if(lag>0)
+        position=pop_position.load(std::memory_order_relaxed);
+    }
+    value=std::move(cell->value);
+    cell->sequence.store(position+mask+1,std::memory_order_release);
+    return true;
+  }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+  std::unique_ptr<Cell[]> cells;
+  size_t mask;
+  alignas(64) std::atomic<size_t> push_position{0};
+  alignas(64) std::atomic<size_t> pop_position{0};
+};
+
+struct StreamColumn {
+  std::array<char,8> dtype;
+  uint32_t width;
+  uint8_t value_size;
+  size_t first_block;
+};
+
+//rows of every column, filled by one thread and then handed to the writer
+//values are copied in as raw bytes, so they must have the type the column was declared with
+class StreamChunk {
+public:
+  uint64_t rows=0;
+
+  inline void AddRows(uint64_t row_count=1) {rows+=row_count;}
+
+  //one or more values of a fixed-width column
+  template<typename T>
+  inline void Append(size_t column,const T& value) {
+    Append(column,&value,1);
+  }
+  template<typename T>
+  inline void Append(size_t column,const T* values,size_t count) {
+    static_assert(std::is_trivially_copyable<T>::value,"stream values are copied as raw bytes");
+    AppendBytes(blocks[(*columns)[column].first_block],values,count*sizeof(T));
+  }
+
+  //one row of a ragged column
+  template<typename T>
+  inline void AppendRow(size_t column,const T* values,uint32_t count) {
+    static_assert(std::is_trivially_copyable<T>::value,"stream values are copied as raw bytes");
+    const size_t first_block=(*columns)[column].first_block;
+    AppendBytes(blocks[first_block],&count,sizeof(count));
+    AppendBytes(blocks[first_block+1],values,count*sizeof(T));
+  }
+
+  //empty the chunk, keeping its buffers
+  inline void Clear() {
+    rows=0;
+    for(std::vector<uint8_t>& block : blocks)
+      block.clear();
+  }
+
+private:
+  friend class StreamWriter;
+  const std::vector<StreamColumn>* columns=nullptr;
+  std::vector<std::vector<uint8_t>> blocks;
+
+  static inline void AppendBytes(std::vector<uint8_t>& block,const void* values,size_t bytes) {
+    const size_t block_end=block.size();
+    block.resize(block_end+bytes);
+    std::memcpy(block.data()+block_end,values,bytes);
+  }
+};
+
+//declare the columns, Start the background thread, then Submit filled chunks from any thread
+//chunks are written in the order they are submitted, and Submit only waits if queue_capacity chunks are already pending
+class StreamWriter {
+public:
+  static constexpr bool compression_available=POLYOMINO_ZLIB;
+
+  explicit StreamWriter(std::string f_name,size_t queue_capacity=16) : file_name(std::move(f_name)), pending_chunks(queue_capacity), free_chunks(queue_capacity) {}
+  StreamWriter(const StreamWriter&)=delete;
+  StreamWriter& operator=(const StreamWriter&)=delete;
+  ~StreamWriter() {Close();}
+
+  //columns must all be added before Start, and return the index used to fill chunks
+  template<typename T>
+  inline size_t AddColumn(const std::string& name,uint32_t width=1) {
+    return RegisterColumn(name,StreamDtype<T>(),width ? width : 1,sizeof(T));
+  }
+  template<typename T>
+  inline size_t AddRaggedColumn(const std::string& name) {
+    return RegisterColumn(name,StreamDtype<T>(),0,sizeof(T));
+  }
+
+  //open the file and write the column directory, compressing blocks if requested and compiled with POLYOMINO_ZLIB
+  inline bool Start(bool compress=false) {
+    if(writer_thread.joinable() || columns.empty())
+      return false;
+    output_file.open(file_name,std::ios::binary | std::ios::trunc);
+    if(!output_file)
+      return false;
+
+    StreamFileHeader header{};
+    std::memcpy(header.magic,StreamFileHeader::MAGIC,sizeof(header.magic));
+    header.version=StreamFileHeader::VERSION;
+    header.column_count=static_cast<uint32_t>(columns.size());
+    output_file.write(reinterpret_cast<const char*>(&header),sizeof(header));
+    for(size_t column=0;column<columns.size();++column) {
+      StreamColumnHeader column_header{};
+      column_names[column].copy(column_header.name,sizeof(column_header.name)-1);
+      std::memcpy(column_header.dtype,columns[column].dtype.data(),sizeof(column_header.dtype));
+      column_header.width=columns[column].width;
+      output_file.write(reinterpret_cast<const char*>(&column_header),sizeof(column_header));
+    }
+    if(!output_file)
+      return false;
+
+    compress_blocks=compress && compression_available;
+    closing.store(false,std::memory_order_relaxed);
+    writer_thread=std::thread([this]{WriterLoop();});
+    return true;
+  }
+
+  //an empty chunk for this writer's columns, reusing a written chunk's buffers where possible
+  inline std::unique_ptr<StreamChunk> NewChunk() {
+    std::unique_ptr<StreamChunk> chunk;
+    if(!free_chunks.TryPop(chunk)) {
+      chunk.reset(new StreamChunk);
+      chunk->columns=&columns;
+      chunk->blocks.resize(block_count);
+    }
+    return chunk;
+  }
+
+  //queue a chunk for writing, returning false if its columns do not all hold its rows or an earlier write failed
+  inline bool Submit(std::unique_ptr<StreamChunk> chunk) {
+    if(!writer_thread.joinable() || failed.load(std::memory_order_relaxed) || !chunk || !Consistent(*chunk))
+      return false;
+    for(size_t spins=0;!pending_chunks.TryPush(chunk);++spins) {
+      if(spins==0)
+        submit_stalls.fetch_add(1,std::memory_order_relaxed);
+      Backoff(spins);
+    }
+    return true;
+  }
+
+  //write everything submitted so far and close the file, returning false if anything could not be written
+  //no chunk may be submitted during or after closing
+  inline bool Close() {
+    if(writer_thread.joinable()) {
+      closing.store(true,std::memory_order_release);
+      writer_thread.join();
+      output_file.close();
+    }
+    return !failed.load(std::memory_order_relaxed);
+  }
+
+  //number of submissions that found the queue full, and so waited on the disk
+  inline uint64_t SubmitStalls() const {return submit_stalls.load(std::memory_order_relaxed);}
+
+private:
+  std::string file_name;
+  std::vector<StreamColumn> columns;
+  std::vector<std::string> column_names;
+  size_t block_count=0;
+
+  BoundedQueue<std::unique_ptr<StreamChunk>> pending_chunks, free_chunks;
+  std::thread writer_thread;
+  std::ofstream output_file;
+  std::atomic<bool> closing{false}, failed{false};
+  std::atomic<uint64_t> submit_stalls{0};
+  bool compress_blocks=false;
+
+  inline size_t RegisterColumn(const std::string& name,std::array<char,8> dtype,uint32_t width,uint8_t value_size) {
+    if(writer_thread.joinable())
+      return columns.size();
+    columns.push_back(StreamColumn{dtype,width,value_size,block_count});
+    column_names.emplace_back(name);
+    block_count+=width ? 1 : 2;
+    return columns.size()-1;
+  }
+
+  inline bool Consistent(const StreamChunk& chunk) const {
+    for(const StreamColumn& column : columns) {
+      const std::vector<uint8_t>& block=chunk.blocks[column.first_block];
+      if(column.width ? block.size()!=chunk.rows*column.width*column.value_size : block.size()!=chunk.rows*sizeof(uint32_t) || chunk.blocks[column.first_block+1].size()%column.value_size)
+        return false;
+    }
+    return true;
+  }
+
+  //spin briefly, then yield, then sleep, so an idle writer does not hold a core
+  static inline void Backoff(size_t spins) {
+    if(spins<64)
+      std::this_thread::yield();
+    else
+      std::this_thread::sleep_for(std::chrono::microseconds(spins<1024 ? 10 : 200));
+  }
+
+  inline void WriterLoop() {
+    std::unique_ptr<StreamChunk> chunk;
+    for(size_t idle=0;;) {
+      if(!pending_chunks.TryPop(chunk)) {
+        //every submission happened before closing, so a queue found empty after closing is empty for good
+        if(closing.load(std::memory_order_acquire) && !pending_chunks.TryPop(chunk))
+          break;
+        if(!chunk) {
+          Backoff(idle++);
+          continue;
+        }
+      }
+      idle=0;
+      if(!failed.load(std::memory_order_relaxed) && !WriteChunk(*chunk))
+        failed.store(true,std::memory_order_relaxed);
+      chunk->Clear();
+      free_chunks.TryPush(chunk);
+      chunk.reset();
+    }
+    output_file.flush();
+    if(!output_file)
+      failed.store(true,std::memory_order_relaxed);
+  }
+
+  inline bool WriteChunk(const StreamChunk& chunk) {
+    std::vector<StreamBlockHeader> block_headers(block_count);
+    std::vector<const std::vector<uint8_t>*> stored_blocks(block_count);
+    std::vector<std::vector<uint8_t>> compressed_blocks(compress_blocks ? block_count : 0);
+    uint64_t payload_bytes=block_count*sizeof(StreamBlockHeader);
+
+    for(const StreamColumn& column : columns)
+      for(size_t block=column.first_block;block<column.first_block+(column.width ? 1 : 2);++block) {
+        const std::vector<uint8_t>& raw_block=chunk.blocks[block];
+        const bool lengths_block=!column.width && block==column.first_block;
+        StreamBlockHeader& block_header=block_headers[block];
+        block_header.count=raw_block.size()/(lengths_block ? sizeof(uint32_t) : column.value_size);
+        block_header.codec=StreamBlockHeader::RAW;
+        stored_blocks[block]=&raw_block;
+#if POLYOMINO_ZLIB
+        if(compress_blocks && !raw_block.empty()) {
+          std::vector<uint8_t>& compressed=compressed_blocks[block];
+          uLongf compressed_size=compressBound(raw_block.size());
+          compressed.resize(compressed_size);
+          if(compress2(compressed.data(),&compressed_size,raw_block.data(),raw_block.size(),Z_BEST_SPEED)==Z_OK && compressed_size<raw_block.size()) {
+            compressed.resize(compressed_size);
+            block_header.codec=StreamBlockHeader::ZLIB;
+            stored_blocks[block]=&compressed;
+          }
+        }
+#endif
+        block_header.stored_bytes=stored_blocks[block]->size();
+        payload_bytes+=AlignedTableOffset(block_header.stored_bytes);
+      }
+
+    StreamChunkHeader chunk_header{};
+    std::memcpy(chunk_header.magic,StreamChunkHeader::MAGIC,sizeof(chunk_header.magic));
+    chunk_header.block_count=static_cast<uint32_t>(block_count);
+    chunk_header.rows=chunk.rows;
+    chunk_header.payload_bytes=payload_bytes;
+    output_file.write(reinterpret_cast<const char*>(&chunk_header),sizeof(chunk_header));
+    output_file.write(reinterpret_cast<const char*>(block_headers.data()),block_count*sizeof(StreamBlockHeader));
+
+    constexpr char padding[8]={};
+    for(const std::vector<uint8_t>* stored_block : stored_blocks) {
+      output_file.write(reinterpret_cast<const char*>(stored_block->data()),stored_block->size());
+      output_file.write(padding,AlignedTableOffset(stored_block->size())-stored_block->size());
+    }
+    return static_cast<bool>(output_file);
+  }
+};
+
+//per-generation evolution output, one row per genotype with its generation, index, fitness, genotype, build pids, and optionally its interactions
+//interactions are stored as flattened (interface,interface) pairs, as returned with the assembly or collected by PopulationEvolution with collect_interactions set
+template<typename Genotype>
+class GenerationStream {
+public:
+  using interface_type = typename Genotype::value_type;
+
+  explicit GenerationStream(std::string f_name,bool compress=false,size_t queue_capacity=16) : writer(std::move(f_name),queue_capacity) {
+    generation_column=writer.AddColumn<uint32_t>("generation");
+    index_column=writer.AddColumn<uint32_t>("genotype_index");
+    fitness_column=writer.AddColumn<double>("fitness");
+    genotype_column=writer.AddRaggedColumn<interface_type>("genotype");
+    pid_size_column=writer.AddRaggedColumn<uint8_t>("pid_size");
+    pid_index_column=writer.AddRaggedColumn<uint16_t>("pid_index");
+    interaction_column=writer.AddRaggedColumn<uint32_t>("interactions");
+    started=writer.Start(compress);
+  }
+
+  //copy one generation into a chunk and queue it, the formatting is only memcpy so the caller returns straight away
+  inline bool Record(uint32_t generation,const std::vector<Genotype>& genotypes,const std::vector<double>& fitnesses,const std::vector<std::vector<Phenotype_ID>>& genotype_pids,const std::vector<std::set<InteractionPair>>* interactions=nullptr) {
+    if(!started)
+      return false;
+    std::unique_ptr<StreamChunk> chunk=writer.NewChunk();
+    thread_local std::vector<uint8_t> pid_sizes;
+    thread_local std::vector<uint16_t> pid_indices;
+    thread_local std::vector<uint32_t> interaction_pairs;
+    for(size_t index=0;index<genotypes.size();++index) {
+      chunk->Append(generation_column,generation);
+      chunk->Append(index_column,static_cast<uint32_t>(index));
+      chunk->Append(fitness_column,index<fitnesses.size() ? fitnesses[index] : 0.);
+      chunk->AppendRow(genotype_column,genotypes[index].data(),static_cast<uint32_t>(genotypes[index].size()));
+
+      pid_sizes.clear();
+      pid_indices.clear();
+      if(index<genotype_pids.size())
+        for(const Phenotype_ID& pid : genotype_pids[index]) {
+          pid_sizes.emplace_back(pid.first);
+          pid_indices.emplace_back(pid.second);
+        }
+      chunk->AppendRow(pid_size_column,pid_sizes.data(),static_cast<uint32_t>(pid_sizes.size()));
+      chunk->AppendRow(pid_index_column,pid_indices.data(),static_cast<uint32_t>(pid_indices.size()));
+
+      interaction_pairs.clear();
+      if(interactions && index<interactions->size())
+        for(const InteractionPair& interaction : (*interactions)[index]) {
+          interaction_pairs.emplace_back(static_cast<uint32_t>(interaction.first));
+          interaction_pairs.emplace_back(static_cast<uint32_t>(interaction.second));
+        }
+      chunk->AppendRow(interaction_column,interaction_pairs.data(),static_cast<uint32_t>(interaction_pairs.size()));
+    }
+    chunk->AddRows(genotypes.size());
+    return writer.Submit(std::move(chunk));
+  }
+
+  inline bool Close() {return writer.Close();}
+
+  StreamWriter writer;
+
+private:
+  size_t generation_column, index_column, fitness_column, genotype_column, pid_size_column, pid_index_column, interaction_column;
+  bool started=false;
+};
@@ -0,0 +1,339 @@
+#pragma once
+#include "core_phenotype.hpp"
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//versioned binary phenotype table, laid out so it can be memory-mapped and used in place
+//  header | bucket directory | phenotype records | hash index | fitness column (optional) | tilings
+//buckets are ordered by phenotype size, and hold their phenotypes in pid order, so the pid is (size,position in bucket)
+//each bucket's hash index is sorted by hash, so lookups are a binary search rather than building a hash table at startup
+//all values are stored in native byte order, and the header records the layout version
+struct BinaryTableHeader {
+  static constexpr char MAGIC[8]={'P','O','L','Y','T','A','B','L'};
+  static constexpr uint32_t VERSION=1;
+  static constexpr uint32_t HAS_FITNESSES=1;
+
+  char magic[8];
+  uint32_t version, flags;
+  uint64_t bucket_count, phenotype_count, tiling_bytes;
+  uint64_t directory_offset, record_offset, hash_offset, fitness_offset, tiling_offset, file_size;
+};
+
+struct BinaryTableBucket {
+  uint8_t size;
+  uint8_t padding[3];
+  uint32_t phenotype_count;
+  uint64_t first_record;
+};
+
+struct BinaryTableRecord {
+  uint64_t tiling_start;
+  uint8_t dx,dy;
+  uint8_t padding[6];
+};
+
+struct BinaryTableHash {
+  uint64_t hash;
+  uint32_t position;
+  uint32_t padding;
+};
+
+//detect tables carrying per-pid fitnesses, so the fitness column is written and read alongside the phenotypes
+template<class Table, class=void>
+struct HasPhenotypeFitnesses : std::false_type {};
+template<class Table>
+struct HasPhenotypeFitnesses<Table,std::void_t<decltype(std::declval<Table&>().phenotype_fitnesses)>> : std::true_type {};
+template<class Table, class=void>
+struct HasFitnessSync : std::false_type {};
+template<class Table>
+struct HasFitnessSync<Table,std::void_t<decltype(std::declval<Table&>().SyncFitnesses())>> : std::true_type {};
+
+inline uint64_t AlignedTableOffset(uint64_t offset) {return (offset+7)&~uint64_t(7);}
+
+//write known phenotypes (and optionally their fitnesses, indexed the same way) in the binary format
+inline bool WriteBinaryTable(const std::unordered_map<uint8_t,std::vector<Phenotype>>& known_phenotypes,std::string f_name,const std::unordered_map<uint8_t,std::vector<double>>* phenotype_fitnesses=nullptr) {
+  std::vector<uint8_t> sizes;
+  for(const auto& kv : known_phenotypes)
+    if(!kv.second.empty())
+      sizes.emplace_back(kv.first);
+  std::sort(sizes.begin(),sizes.end());
+
+  std::vector<BinaryTableBucket> buckets;
+  std::vector<BinaryTableRecord> records;
+  std::vector<BinaryTableHash> hashes;
+  std::vector<double> fitnesses;
+  std::vector<uint8_t> tilings;
+
+  for(uint8_t size : sizes) {
+    const std::vector<Phenotype>& bucket=known_phenotypes.at(size);
+    const std::vector<double>* bucket_fitnesses=nullptr;
+    if(phenotype_fitnesses)
+      if(auto fit_iter=phenotype_fitnesses->find(size); fit_iter!=phenotype_fitnesses->end())
+        bucket_fitnesses=&fit_iter->second;
+
+    buckets.push_back(BinaryTableBucket{size,{},static_cast<uint32_t>(bucket.size()),records.size()});
+    const size_t hash_start=hashes.size();
+    for(uint32_t position=0;position<bucket.size();++position) {
+      const Phenotype& phen=bucket[position];
+      records.push_back(BinaryTableRecord{tilings.size(),phen.dx,phen.dy,{}});
+      tilings.insert(tilings.end(),phen.tiling.begin(),phen.tiling.end());
+      hashes.push_back(BinaryTableHash{PhenotypeHash(phen),position,0});
+      if(phenotype_fitnesses)
+        fitnesses.emplace_back(bucket_fitnesses && position<bucket_fitnesses->size() ? (*bucket_fitnesses)[position] : 0);
+    }
+    std::sort(hashes.begin()+hash_start,hashes.end(),[](const BinaryTableHash& lhs,const BinaryTableHash& rhs) {return std::tie(lhs.hash,lhs.position)<std::tie(rhs.hash,rhs.position);});
+  }
+
+  BinaryTableHeader header{};
+  std::copy(std::begin(BinaryTableHeader::MAGIC),std::end(BinaryTableHeader::MAGIC),header.magic);
+  header.version=BinaryTableHeader::VERSION;
+  header.flags=phenotype_fitnesses ? BinaryTableHeader::HAS_FITNESSES : 0;
+  header.bucket_count=buckets.size();
+  header.phenotype_count=records.size();
+  header.tiling_bytes=tilings.size();
+  header.directory_offset=AlignedTableOffset(sizeof(BinaryTableHeader));
+  header.record_offset=AlignedTableOffset(header.directory_offset+buckets.size()*sizeof(BinaryTableBucket));
+  header.hash_offset=AlignedTableOffset(header.record_offset+records.size()*sizeof(BinaryTableRecord));
+  header.fitness_offset=AlignedTableOffset(header.hash_offset+hashes.size()*sizeof(BinaryTableHash));
+  header.tiling_offset=AlignedTableOffset(header.fitness_offset+fitnesses.size()*sizeof(double));
+  header.file_size=header.tiling_offset+tilings.size();
+
+  std::ofstream fout(f_name,std::ios::binary);
+  if(!fout)
+    return false;
+  auto write_section=[&fout](uint64_t offset,const void* data,size_t bytes) {
+    for(auto position=static_cast<uint64_t>(fout.tellp());position<offset;++position)
+      fout.put(0);
+    fout.write(static_cast<const char*>(data),bytes);
+  };
+  write_section(0,&header,sizeof(header));
+  write_section(header.directory_offset,buckets.data(),buckets.size()*sizeof(BinaryTableBucket));
+  write_section(header.record_offset,records.data(),records.size()*sizeof(BinaryTableRecord));
+  write_section(header.hash_offset,hashes.data(),hashes.size()*sizeof(BinaryTableHash));
+  write_section(header.fitness_offset,fitnesses.data(),fitnesses.size()*sizeof(double));
+  write_section(header.tiling_offset,tilings.data(),tilings.size());
+  return static_cast<bool>(fout);
+}
+
+//write a table's known phenotypes, including the fitness column if the table has fitnesses
+template<class Table>
+inline bool WriteBinaryTable(const Table& table,std::string f_name) {
+  if constexpr(HasPhenotypeFitnesses<Table>::value)
+    return WriteBinaryTable(table.known_phenotypes,f_name,&table.phenotype_fitnesses);
+  else
+    return WriteBinaryTable(table.known_phenotypes,f_name);
+}
+
+//read-only view of a binary table mapped into memory, classifying like a loaded table with FIXED_TABLE set
+//the mapping is shared, so concurrent processes using the same file share the same physical pages
+//unknown phenotypes are returned as NULL_pid, and pids are identical to those of the table that was written
+//it can stand in for a fixed table in AssembleBuilds (and its analysed and early stopping versions) and PhenotypeFrequencies,
+//while PopulationEvolution and GenotypeEnumeration need a concurrent table, into which LoadBinaryTable can load the same file
+class MappedPhenotypeTable {
+public:
+  static constexpr bool FIXED_TABLE=true;
+  inline static uint16_t& phenotype_builds=PhenotypeTable::phenotype_builds;
+  inline static double& UND_threshold=PhenotypeTable::UND_threshold;
+
+  MappedPhenotypeTable(void) {bucket_lookup.fill(NO_BUCKET);}
+  MappedPhenotypeTable(std::string f_name) : MappedPhenotypeTable() {MapTable(f_name);}
+  MappedPhenotypeTable(const MappedPhenotypeTable&)=delete;
+  MappedPhenotypeTable& operator=(const MappedPhenotypeTable&)=delete;
+  ~MappedPhenotypeTable() {UnmapTable();}
+
+  //map a binary table, returning false (and leaving the table empty) if it is missing or not a valid table of this version
+  inline bool MapTable(std::string f_name) {
+    UnmapTable();
+    const int file_descriptor=open(f_name.c_str(),O_RDONLY);
+    if(file_descriptor<0)
+      return false;
+    struct stat file_status;
+    if(fstat(file_descriptor,&file_status)==0 && static_cast<size_t>(file_status.st_size)>=sizeof(BinaryTableHeader)) {
+      void* mapping=mmap(nullptr,file_status.st_size,PROT_READ,MAP_SHARED,file_descriptor,0);
+      if(mapping!=MAP_FAILED) {
+        mapped_data=static_cast<const uint8_t*>(mapping);
+        mapped_bytes=file_status.st_size;
+      }
+    }
+    close(file_descriptor);
+
+    if(!mapped_data || !ValidLayout()) {
+      UnmapTable();
+      return false;
+    }
+    for(uint32_t bucket_index=0;bucket_index<header->bucket_count;++bucket_index)
+      bucket_lookup[buckets[bucket_index].size]=bucket_index;
+    return true;
+  }
+
+  inline void UnmapTable() {
+    if(mapped_data)
+      munmap(const_cast<uint8_t*>(mapped_data),mapped_bytes);
+    mapped_data=nullptr;
+    mapped_bytes=0;
+    header=nullptr;
+    bucket_lookup.fill(NO_BUCKET);
+  }
+
+  inline bool IsMapped() const {return mapped_data!=nullptr;}
+  inline bool HasFitnesses() const {return header && (header->flags&BinaryTableHeader::HAS_FITNESSES);}
+  inline size_t PhenotypeCount() const {return header ? header->phenotype_count : 0;}
+  inline size_t BucketSize(uint8_t phenotype_size) const {return bucket_lookup[phenotype_size]==NO_BUCKET ? 0 : buckets[bucket_lookup[phenotype_size]].phenotype_count;}
+
+  //known pid of a phenotype, or NULL_pid if the table does not contain it
+  inline Phenotype_ID GetPhenotypeID(const Phenotype& phen) const {
+    const uint8_t phenotype_size=std::count_if(phen.tiling.begin(),phen.tiling.end(),[](const int c){return c != 0;});
+    if(bucket_lookup[phenotype_size]==NO_BUCKET)
+      return NULL_pid;
+    const BinaryTableBucket& bucket=buckets[bucket_lookup[phenotype_size]];
+    const uint64_t phen_hash=PhenotypeHash(phen);
+
+    const BinaryTableHash* bucket_hashes=hashes+bucket.first_record;
+    for(auto match=std::lower_bound(bucket_hashes,bucket_hashes+bucket.phenotype_count,phen_hash,[](const BinaryTableHash& entry,uint64_t target) {return entry.hash<target;});
+        match!=bucket_hashes+bucket.phenotype_count && match->hash==phen_hash;++match) {
+      const BinaryTableRecord& record=records[bucket.first_record+match->position];
+      if(record.dx==phen.dx && record.dy==phen.dy && std::equal(phen.tiling.begin(),phen.tiling.end(),tilings+record.tiling_start))
+        return Phenotype_ID{phenotype_size,match->position};
+    }
+    return NULL_pid;
+  }
+
+  //fixed table interface, where every pid is already known (or NULL_pid or UNBOUND_pid), so there is nothing to promote or clear
+  inline bool IsKnown(Phenotype_ID pid) const {return pid.second<BucketSize(pid.first);}
+  inline void RelabelPIDs(std::vector<Phenotype_ID>&,bool=false) {}
+  template<typename map_val>
+  inline void RelabelMaps(std::map<Phenotype_ID, map_val>&,bool=false) {}
+  inline void ClearIncomplete() {}
+  inline void PhenotypeFrequencies(const std::vector<Phenotype_ID >& pids,std::vector<std::pair<Phenotype_ID,uint16_t> >& ID_counts,const Phenotype_ID RARE_pid=NULL_pid, bool allow_existing=false) const {
+    CountPhenotypeFrequencies(*this,pids,ID_counts,RARE_pid,allow_existing);
+  }
+
+  //copy out the phenotype of a known pid
+  inline Phenotype GetPhenotype(Phenotype_ID pid) const {
+    const BinaryTableRecord& record=records[buckets[bucket_lookup[pid.first]].first_record+pid.second];
+    return Phenotype(record.dx,record.dy,InlineTiling(tilings+record.tiling_start,tilings+record.tiling_start+record.dx*record.dy));
+  }
+
+  //stored fitness of a known pid, or 0 if the table was written without fitnesses
+  inline double PhenotypeFitness(Phenotype_ID pid) const {
+    if(!HasFitnesses() || pid==NULL_pid || bucket_lookup[pid.first]==NO_BUCKET)
+      return 0;
+    return fitnesses[buckets[bucket_lookup[pid.first]].first_record+pid.second];
+  }
+
+  //copy the whole table into the usual per-size containers, replacing the buckets of every size in the table
+  inline void ExportPhenotypes(std::unordered_map<uint8_t,std::vector<Phenotype>>& known_phenotypes) const {
+    for(uint32_t bucket_index=0;header && bucket_index<header->bucket_count;++bucket_index) {
+      const BinaryTableBucket& bucket=buckets[bucket_index];
+      std::vector<Phenotype>& known_bucket=known_phenotypes[bucket.size];
+      known_bucket.clear();
+      known_bucket.reserve(bucket.phenotype_count);
+      for(uint32_t position=0;position<bucket.phenotype_count;++position)
+        known_bucket.emplace_back(GetPhenotype(Phenotype_ID{bucket.size,position}));
+    }
+  }
+  inline void ExportFitnesses(std::unordered_map<uint8_t,std::vector<double>>& phenotype_fitnesses) const {
+    for(uint32_t bucket_index=0;header && bucket_index<header->bucket_count;++bucket_index) {
+      const BinaryTableBucket& bucket=buckets[bucket_index];
+      std::vector<double>& fitness_bucket=phenotype_fitnesses[bucket.size];
+      fitness_bucket.clear();
+      for(uint32_t position=0;position<bucket.phenotype_count;++position)
+        fitness_bucket.emplace_back(PhenotypeFitness(Phenotype_ID{bucket.size,position}));
+    }
+  }
+
+private:
+  static constexpr uint32_t NO_BUCKET=UINT32_MAX;
+
+  const uint8_t* mapped_data=nullptr;
+  size_t mapped_bytes=0;
+  const BinaryTableHeader* header=nullptr;
+  const BinaryTableBucket* buckets=nullptr;
+  const BinaryTableRecord* records=nullptr;
+  const BinaryTableHash* hashes=nullptr;
+  const double* fitnesses=nullptr;
+  const uint8_t* tilings=nullptr;
+  std::array<uint32_t,256> bucket_lookup;
+
+  //check the header and every section fits in the mapped file before trusting any offsets
+  inline bool ValidLayout() {
+    header=reinterpret_cast<const BinaryTableHeader*>(mapped_data);
+    if(!std::equal(std::begin(BinaryTableHeader::MAGIC),std::end(BinaryTableHeader::MAGIC),header->magic) || header->version!=BinaryTableHeader::VERSION || header->file_size>mapped_bytes)
+      return false;
+    auto section_fits=[this](uint64_t offset,uint64_t count,size_t element) {return offset%8==0 && count<=mapped_bytes/element && offset+count*element<=mapped_bytes;};
+    if(!section_fits(header->directory_offset,header->bucket_count,sizeof(BinaryTableBucket)) || header->bucket_count>256 ||
+       !section_fits(header->record_offset,header->phenotype_count,sizeof(BinaryTableRecord)) ||
+       !section_fits(header->hash_offset,header->phenotype_count,sizeof(BinaryTableHash)) ||
+       !section_fits(header->fitness_offset,HasFitnesses() ? header->phenotype_count : 0,sizeof(double)) ||
+       !section_fits(header->tiling_offset,header->tiling_bytes,1))
+      return false;
+
+    buckets=reinterpret_cast<const BinaryTableBucket*>(mapped_data+header->directory_offset);
+    records=reinterpret_cast<const BinaryTableRecord*>(mapped_data+header->record_offset);
+    hashes=reinterpret_cast<const BinaryTableHash*>(mapped_data+header->hash_offset);
+    fitnesses=reinterpret_cast<const double*>(mapped_data+header->fitness_offset);
+    tilings=mapped_data+header->tiling_offset;
+
+    for(uint32_t bucket_index=0;bucket_index<header->bucket_count;++bucket_index)
+      if(buckets[bucket_index].first_record+buckets[bucket_index].phenotype_count>header->phenotype_count)
+        return false;
+    for(uint64_t record_index=0;record_index<header->phenotype_count;++record_index)
+      if(records[record_index].tiling_start+records[record_index].dx*records[record_index].dy>header->tiling_bytes)
+        return false;
+    return true;
+  }
+};
+
+//load a binary table into a table's usual containers (and its fitnesses, if both have them), replacing everything the table held
+//a table that cannot be loaded is left unchanged
+template<class Table>
+inline bool LoadBinaryTable(Table& table,std::string f_name) {
+  MappedPhenotypeTable mapped_table;
+  if(!mapped_table.MapTable(f_name))
+    return false;
+  table.ClearTable();
+  mapped_table.ExportPhenotypes(table.known_phenotypes);
+  if constexpr(HasPhenotypeFitnesses<Table>::value) {
+    if(mapped_table.HasFitnesses())
+      mapped_table.ExportFitnesses(table.phenotype_fitnesses);
+    for(auto& kv : table.known_phenotypes)
+      table.phenotype_fitnesses[kv.first].resize(kv.second.size(),0);
+    if constexpr(HasFitnessSync<Table>::value)
+      table.SyncFitnesses();
+  }
+  return true;
+}
+
+//convert a text table (lines of "dx dy tiling", as read by PhenotypeTable::LoadTable) into the binary format
+inline bool ConvertTextTableToBinary(std::string text_name,std::string binary_name) {
+  PhenotypeTable table;
+  table.LoadTable(text_name);
+  return WriteBinaryTable(table,binary_name);
+}
+
+//convert a binary table back to the text format, one phenotype per line in pid order
+inline bool ConvertBinaryTableToText(std::string binary_name,std::string text_name) {
+  MappedPhenotypeTable mapped_table;
+  if(!mapped_table.MapTable(binary_name))
+    return false;
+  std::unordered_map<uint8_t,std::vector<Phenotype>> known_phenotypes;
+  mapped_table.ExportPhenotypes(known_phenotypes);
+
+  std::vector<uint8_t> sizes;
+  for(const auto& kv : known_phenotypes)
+    sizes.emplace_back(kv.first);
+  std::sort(sizes.begin(),sizes.end());
+
+  std::ofstream fout(text_name);
+  for(uint8_t size : sizes)
+    for(const Phenotype& known : known_phenotypes[size]) {
+      fout<<+known.dx<<" "<<+known.dy<<" ";
+      for(uint8_t tile : known.tiling)
+        fout<<+tile<<" ";
+      fout<<"\n";
+    }
+  return static_cast<bool>(fout);
+}
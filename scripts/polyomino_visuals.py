@@ -3,6 +3,7 @@ from matplotlib.patches import Rectangle
 from itertools import product
 import numpy as np
 from scipy.interpolate import splprep,splev
+import zlib
 
 def VisualiseSingleShape(shape,ax=None,corner=(0,1),extent=1,add_direction=False):
     cols=['darkgreen','royalblue','firebrick','goldenrod','mediumorchid']
@@ -187,3 +188,62 @@ def AddConnectionPatch(ax,pts,weight):
      ln=ax.plot(x_new, y_new,c='gray', ls='--',lw=weight*2,alpha=faded_lines_alpha)[0]
      
      return (ln,ar)
+
+##streamed binary output of core_stream_io.hpp (e.g. GenerationStream), read without parsing text
+stream_column_dtype=np.dtype([('name','S48'),('dtype','S8'),('width','u4'),('padding','u4')])
+stream_chunk_dtype=np.dtype([('magic','S4'),('block_count','u4'),('rows','u8'),('payload_bytes','u8')])
+stream_block_dtype=np.dtype([('count','u8'),('stored_bytes','u8'),('codec','u4'),('padding','u4')])
+
+def _StreamBlock(data,offset,block,dtype):
+     stored=data[offset:offset+int(block['stored_bytes'])]
+     if block['codec']==1:
+          return np.frombuffer(zlib.decompress(stored.tobytes()),dtype=dtype)
+     return stored.view(dtype)
+
+##yields a dict per chunk, fixed columns as arrays (rows,width) or (rows,) and ragged columns as (values,offsets), with row i in values[offsets[i]:offsets[i+1]]
+##uncompressed columns are views into the memory-mapped file, and a chunk cut short by an interrupted run is skipped
+def IterPolyominoStream(file_name):
+     data=np.memmap(file_name,dtype=np.uint8,mode='r')
+     if data[:8].tobytes()!=b'POLYSTRM' or data[8:12].view('u4')[0]!=1:
+          raise ValueError('{} is not a version 1 polyomino stream'.format(file_name))
+     column_count=int(data[12:16].view('u4')[0])
+     offset=16+column_count*stream_column_dtype.itemsize
+     columns=data[16:offset].view(stream_column_dtype)
+
+     while offset+stream_chunk_dtype.itemsize<=len(data):
+          chunk=data[offset:offset+stream_chunk_dtype.itemsize].view(stream_chunk_dtype)[0]
+          offset+=stream_chunk_dtype.itemsize
+          if chunk['magic']!=b'CHNK' or offset+int(chunk['payload_bytes'])>len(data):
+               return
+          blocks=data[offset:offset+int(chunk['block_count'])*stream_block_dtype.itemsize].view(stream_block_dtype)
+          block_offset=offset+blocks.nbytes
+          offset+=int(chunk['payload_bytes'])
+
+          chunk_columns,nth_block={},0
+          for column in columns:
+               dtype=np.dtype(column['dtype'].decode())
+               values=[]
+               for block in blocks[nth_block:nth_block+(1 if column['width'] else 2)]:
+                    values.append(_StreamBlock(data,block_offset,block,'u4' if len(values)==0 and not column['width'] else dtype))
+                    block_offset+=(int(block['stored_bytes'])+7)&~7
+                    nth_block+=1
+               if column['width']:
+                    chunk_columns[column['name'].decode()]=values[0].reshape(-1,column['width']) if column['width']>1 else values[0]
+               else:
+                    chunk_columns[column['name'].decode()]=(values[1],np.concatenate((np.zeros(1,dtype=np.int64),np.cumsum(values[0],dtype=np.int64))))
+          yield chunk_columns
+
+##whole stream as one dict of columns in the same form as IterPolyominoStream, concatenating the chunks
+def LoadPolyominoStream(file_name):
+     chunks=list(IterPolyominoStream(file_name))
+     if not chunks:
+          return {}
+     loaded={}
+     for name,first in chunks[0].items():
+          if isinstance(first,tuple):
+               values=np.concatenate([chunk[name][0] for chunk in chunks])
+               lengths=np.concatenate([np.diff(chunk[name][1]) for chunk in chunks])
+               loaded[name]=(values,np.concatenate((np.zeros(1,dtype=np.int64),np.cumsum(lengths,dtype=np.int64))))
+          else:
+               loaded[name]=np.concatenate([chunk[name] for chunk in chunks])
+     return loaded
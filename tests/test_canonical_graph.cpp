@@ -0,0 +1,50 @@
+#include "core_genotype.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+#include <random>
+
+//relabelled copies of a graph must share a key, including when many subunits without edges sit among those with edges
+
+using EdgeList = std::vector<std::pair<InteractionPair,double> >;
+
+//move every subunit to its label in the permutation, keeping the edge pairs ordered
+EdgeList RelabelSubunits(const EdgeList& edges,const std::vector<size_t>& permutation) {
+  EdgeList relabelled;
+  for(const auto& [edge,strength] : edges) {
+    const size_t first=permutation[edge.first/4]*4+edge.first%4, second=permutation[edge.second/4]*4+edge.second%4;
+    relabelled.emplace_back(InteractionPair{std::min(first,second),std::max(first,second)},strength);
+  }
+  std::sort(relabelled.begin(),relabelled.end());
+  return relabelled;
+}
+
+int main() {
+  constexpr size_t SUBUNITS=11;
+  //a cycle over three subunits with equal signatures, leaving eight subunits without edges
+  const EdgeList edges{{{8*4+1,9*4+3},1},{{9*4+1,10*4+3},1},{{8*4+3,10*4+1},1}};
+
+  InteractionGraphKey reference_key,relabelled_key;
+  CanonicalInteractionGraph(edges,true,reference_key);
+
+  std::mt19937 rng(1);
+  std::vector<size_t> permutation(SUBUNITS);
+  std::iota(permutation.begin(),permutation.end(),0);
+  size_t failures=0;
+  for(size_t trial=0;trial<200;++trial) {
+    std::shuffle(permutation.begin(),permutation.end(),rng);
+    //the permutation must keep the highest subunit with an edge last, so the subunit count is the same
+    const EdgeList relabelled=RelabelSubunits(edges,permutation);
+    if(std::max_element(permutation.begin()+8,permutation.end())[0]!=SUBUNITS-1)
+      continue;
+    CanonicalInteractionGraph(relabelled,true,relabelled_key);
+    failures+=!(relabelled_key==reference_key);
+  }
+
+  if(failures) {
+    std::cerr<<failures<<" relabellings did not share the key of the original graph\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,50 @@
+#include "core_phenotype.hpp"
+
+#include <iostream>
+
+//relabelling several pid vectors within one generation must map every pid to the known phenotype it was classified as,
+//including when more phenotypes are promoted than there are builds, so permanent and temporary pid ranges overlap
+
+//distinct phenotypes of the same size, differing only in their tile labels
+std::vector<Phenotype> LabelledLines(uint8_t first_label,size_t count) {
+  std::vector<Phenotype> phenotypes;
+  for(size_t line=0;line<count;++line)
+    phenotypes.emplace_back(4,1,std::vector<uint8_t>{static_cast<uint8_t>(first_label+line),1,1,1});
+  return phenotypes;
+}
+
+template<class Table>
+size_t CheckGenerations() {
+  Table table;
+  size_t failures=0;
+  for(uint8_t generation=0;generation<2;++generation) {
+    std::vector<Phenotype> phenotypes=LabelledLines(2+40*generation,30);
+
+    //two overlapping vectors, each relabelled on its own
+    std::vector<Phenotype_ID> first_pids,second_pids;
+    for(size_t index=0;index<20;++index)
+      first_pids.emplace_back(table.GetPhenotypeID(phenotypes[index]));
+    for(size_t index=10;index<30;++index)
+      second_pids.emplace_back(table.GetPhenotypeID(phenotypes[index]));
+    table.RelabelPIDs(first_pids);
+    table.RelabelPIDs(second_pids);
+
+    for(size_t index=0;index<20;++index)
+      failures+=!table.IsKnown(first_pids[index]) || !(table.known_phenotypes[4][first_pids[index].second]==phenotypes[index]);
+    for(size_t index=0;index<20;++index)
+      failures+=!table.IsKnown(second_pids[index]) || !(table.known_phenotypes[4][second_pids[index].second]==phenotypes[index+10]);
+    table.ClearIncomplete();
+  }
+  failures+=table.known_phenotypes[4].size()!=60;
+  return failures;
+}
+
+int main() {
+  PhenotypeTable::phenotype_builds=10;
+  const size_t failures=CheckGenerations<PhenotypeTable>()+CheckGenerations<ConcurrentPhenotypeTable>();
+  if(failures) {
+    std::cerr<<failures<<" pids were not relabelled to the phenotype they were classified as\n";
+    return 1;
+  }
+  return 0;
+}